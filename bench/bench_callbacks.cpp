@@ -0,0 +1,105 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+ * Measures what it costs to run one callback
+ * stored as spw::Delegate compared to the same
+ * callback stored as std::function. Both get
+ * the same arguments as onReceive() callbacks:
+ * a connected Peer and a fresh copy of the
+ * received bytes in every iteration.
+ * Build with -DBUILD_BENCH=ON and a release
+ * build type to get meaningful numbers.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "../include/simpwire.hpp"
+
+static const size_t EVENTS = 10000000;
+static const uint16_t BENCH_PORT = 23200;
+
+template<typename Callback>
+static double nanosecondsPerEvent(const Callback &callback,
+                                  const spw::Peer &pr,
+                                  const std::vector<uint8_t> &bytes)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for(size_t i = 0; i < EVENTS; ++i)
+    {
+        std::vector<uint8_t> received(bytes);
+        callback(pr, std::move(received));
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+    return elapsed.count() / EVENTS;
+}
+
+int main()
+{
+    spw::TcpNode node;
+    node.doListen(BENCH_PORT, spw::IpVersion::IPV4);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    node.connectTo("127.0.0.1", BENCH_PORT);
+
+    spw::Peer pr;
+    for(int i = 0; i < 100 && !pr.isValid(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        pr = node.latestPeer();
+    }
+
+    if(!pr.isValid())
+    {
+        std::cerr << "Could not connect to port "
+                  << BENCH_PORT << std::endl;
+        return 1;
+    }
+
+    std::vector<uint8_t> bytes(64, 1);
+    size_t total = 0;
+
+    auto callback = [&total](const spw::Peer&,
+                             std::vector<uint8_t> &&dat){
+        total += dat.size();
+    };
+
+    spw::ReceiveCallback delegate = callback;
+    std::function<void(const spw::Peer&, std::vector<uint8_t>&&)>
+        function = callback;
+
+    double delegate_ns = nanosecondsPerEvent(delegate, pr, bytes);
+    double function_ns = nanosecondsPerEvent(function, pr, bytes);
+
+    std::cout << "spw::Delegate: " << delegate_ns << " ns/event" << std::endl;
+    std::cout << "std::function: " << function_ns << " ns/event" << std::endl;
+    std::cout << "(checksum " << total << ")" << std::endl;
+
+    return 0;
+}
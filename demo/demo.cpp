@@ -30,6 +30,7 @@ SOFTWARE.
 constexpr char VERSION[] = "Version";
 constexpr char CONNECT[] = "Connect";
 constexpr char SEND[] = "Send";
+constexpr char SEND_FILE[] = "Send_file";
 constexpr char LISTEN[] = "Listen";
 constexpr char IS_LISTENING[] = "Is_listening"; 
 constexpr char SHOW_LISTEN_PORT[] = "Show_listen_port"; 
@@ -83,6 +84,7 @@ void listCommands()
     << "> - " << VERSION << std::endl
     << "> - " << CONNECT << " <ip> <port> " << std::endl
     << "> - " << SEND << " <id> <data> " << std::endl
+    << "> - " << SEND_FILE << " <id> <path> " << std::endl
     << "> - " << LISTEN << " <port> " 
     << " [" << IPv4 << "|" << IPv6 << "] "    << std::endl
     << "> - " << IS_LISTENING << std::endl
@@ -283,6 +285,30 @@ int main(int argc, char **argv)
                           << " needs id and data." << std::endl;
             }
         }
+        else if(cmd_tokens[0] == std::string(SEND_FILE))
+        {
+            if(cmd_tokens.size() >= 3)
+            {
+                try
+                {
+                    uint64_t peer_id = static_cast<uint64_t>(std::stoi(cmd_tokens[1]));
+                    node.sendFile(peerAt(peer_id, node.allPeers()), cmd_tokens[2]);
+                }
+                catch(std::invalid_argument &e)
+                {
+                    std::cerr << "> Specified id could not be parsed." << std::endl;
+                }
+                catch(std::out_of_range &e)
+                {
+                    std::cerr << "> Specified id is to large." << std::endl;
+                }
+            }
+            else
+            {
+                std::cerr << "Error: " << SEND_FILE
+                          << " needs id and path." << std::endl;
+            }
+        }
         else if(cmd_tokens[0] == std::string(LISTEN))
         {
             if(cmd_tokens.size() >= 2)
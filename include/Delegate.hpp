@@ -0,0 +1,245 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/**
+ * @file Delegate.hpp
+ *
+ * Contains the class template Delegate that
+ * TcpNode uses to store callbacks.
+ *
+ */
+#ifndef SPW_DELEGATE_HPP_
+#define SPW_DELEGATE_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace spw
+{
+
+template<typename Signature>
+class Delegate;
+
+/**
+ * @class Delegate
+ * @brief Callable wrapper that never allocates.
+ *
+ * Like std::function, but the callable is always
+ * stored inside the Delegate. Callables that are
+ * larger than Delegate::capacity do not compile.
+ * Lambdas capturing a few references or pointers
+ * and plain functions fit, a std::function fits
+ * as well if a larger callable must be used.
+ * Arguments are passed on exactly as declared in
+ * Signature, so reference arguments are not copied.
+ * An empty std::function or a null function pointer
+ * leaves the Delegate empty.
+*/
+template<typename R, typename... Args>
+class Delegate<R(Args...)>
+{
+public:
+
+    static constexpr size_t capacity = 6 * sizeof(void*);
+
+    Delegate() noexcept = default;
+    Delegate(std::nullptr_t) noexcept {}
+
+    template<typename F,
+             typename Fn = typename std::decay<F>::type,
+             typename = typename std::enable_if<
+                !std::is_same<Fn, Delegate>::value>::type,
+             typename = decltype(
+                std::declval<Fn&>()(std::declval<Args>()...))>
+    Delegate(F &&f)
+    {
+        static_assert(sizeof(Fn) <= capacity,
+            "Callable is too large for spw::Delegate, "
+            "capture less or wrap it in a std::function.");
+        static_assert(alignof(Fn) <= alignof(Storage),
+            "Callable is over-aligned for spw::Delegate.");
+
+        if(isEmptyCallable(f))
+        {
+            return;
+        }
+
+        new (&m_storage) Fn(std::forward<F>(f));
+        m_invoke = &invokeStored<Fn>;
+        m_manage = &manageStored<Fn>;
+    }
+
+    Delegate(const Delegate &other)
+    {
+        copyFrom(other);
+    }
+
+    Delegate(Delegate &&other) noexcept
+    {
+        moveFrom(other);
+    }
+
+    Delegate& operator=(const Delegate &other)
+    {
+        if(this != &other)
+        {
+            reset();
+            copyFrom(other);
+        }
+        return *this;
+    }
+
+    Delegate& operator=(Delegate &&other) noexcept
+    {
+        if(this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Delegate& operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    ~Delegate()
+    {
+        reset();
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return m_invoke != nullptr;
+    }
+
+    R operator()(Args... args) const
+    {
+        return m_invoke(&m_storage, std::forward<Args>(args)...);
+    }
+
+private:
+
+    enum class Operation {COPY, MOVE, DESTROY};
+
+    using Storage = typename std::aligned_storage<
+        capacity, alignof(std::max_align_t)>::type;
+    using Invoker = R (*)(void*, Args&&...);
+    using Manager = void (*)(Operation, void*, void*);
+
+    template<typename Fn>
+    static bool isEmptyCallable(Fn *const &fn)
+    {
+        return fn == nullptr;
+    }
+
+    template<typename C, typename M>
+    static bool isEmptyCallable(M C::*const &fn)
+    {
+        return fn == nullptr;
+    }
+
+    template<typename Signature>
+    static bool isEmptyCallable(const std::function<Signature> &fn)
+    {
+        return !fn;
+    }
+
+    template<typename Fn>
+    static bool isEmptyCallable(const Fn &)
+    {
+        return false;
+    }
+
+    template<typename Fn>
+    static R invokeStored(void *storage, Args&&... args)
+    {
+        return (*static_cast<Fn*>(storage))(std::forward<Args>(args)...);
+    }
+
+    template<typename Fn>
+    static void manageStored(Operation op, void *dst, void *src)
+    {
+        switch(op)
+        {
+            case Operation::COPY:
+                new (dst) Fn(*static_cast<const Fn*>(src));
+                break;
+            case Operation::MOVE:
+                new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+                static_cast<Fn*>(src)->~Fn();
+                break;
+            case Operation::DESTROY:
+                static_cast<Fn*>(dst)->~Fn();
+                break;
+        }
+    }
+
+    void copyFrom(const Delegate &other)
+    {
+        if(other.m_manage)
+        {
+            other.m_manage(Operation::COPY, &m_storage, &other.m_storage);
+        }
+        m_invoke = other.m_invoke;
+        m_manage = other.m_manage;
+    }
+
+    void moveFrom(Delegate &other) noexcept
+    {
+        if(other.m_manage)
+        {
+            other.m_manage(Operation::MOVE, &m_storage, &other.m_storage);
+        }
+        m_invoke = other.m_invoke;
+        m_manage = other.m_manage;
+        other.m_invoke = nullptr;
+        other.m_manage = nullptr;
+    }
+
+    void reset() noexcept
+    {
+        if(m_manage)
+        {
+            m_manage(Operation::DESTROY, &m_storage, nullptr);
+        }
+        m_invoke = nullptr;
+        m_manage = nullptr;
+    }
+
+    mutable Storage m_storage;
+    Invoker m_invoke = nullptr;
+    Manager m_manage = nullptr;
+};
+
+template<typename R, typename... Args>
+constexpr size_t Delegate<R(Args...)>::capacity;
+
+}
+
+#endif //SPW_DELEGATE_HPP_
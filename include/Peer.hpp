@@ -31,9 +31,12 @@ SOFTWARE.
 #define SPW_PEER_HPP_
 
 #include <cstdint>
+#include <functional>
 #include <string>
+#include <vector>
 
 #include "common.hpp"
+#include "Delegate.hpp"
 
 namespace spw
 {
@@ -65,6 +68,9 @@ namespace spw
  *
  * Peer objects evaluate to false when
  * they're not valid.
+ *
+ * Copies of a Peer share its state, so
+ * copying one only counts a reference.
 */
 
 
@@ -96,16 +102,63 @@ public:
     virtual bool isValid() const;
 
     Peer& operator=(const Peer &other);
+    Peer& operator=(Peer &&other);
     bool operator==(const Peer &other) const;
     explicit operator bool() const;
 
 private:
 
+    //Takes over the first reference of state.
+    explicit Peer(PeerPrivate *state);
+
+    void _release();
+
     mutable PeerPrivate *m_private = nullptr;
 };
 
 using PeerList = std::unordered_map<uint64_t, Peer>;
 
+/**
+ * Called exactly once for a message that was
+ * passed to TcpNode::sendData() or TcpNode::sendFile()
+ * together with it. success is true when the whole
+ * message was written to the socket and false when it
+ * was refused or the connection was closed before.
+*/
+using SendCompletion = std::function<void(Peer pr, bool success)>;
+
+/**
+ * Types of the callbacks set with the on...()
+ * functions of TcpNode. Received data is passed
+ * as an rvalue reference, so a callback taking
+ * std::vector<uint8_t> by value gets it moved
+ * and one taking a reference gets no copy at all.
+*/
+using PeerCallback = Delegate<void(const Peer &pr)>;
+using ReceiveCallback = 
+    Delegate<void(const Peer &pr, std::vector<uint8_t> &&bytes)>;
+using SentCallback = Delegate<void(const Peer &pr, size_t amount)>;
+using ListenCallback = Delegate<void(uint16_t listen_port)>;
+using StoppedCallback = Delegate<void()>;
+using ErrorCallback = Delegate<void(const Message &err)>;
+using PeerErrorCallback = 
+    Delegate<void(const Peer &pr, const Message &err)>;
+
+/**
+ * @struct ConnectResult
+ * Outcome of connecting to one endpoint
+ * of TcpNode::connectToAll(). peer is only valid
+ * if connected is set, error describes
+ * the last failure otherwise.
+*/
+struct ConnectResult
+{
+    Endpoint endpoint;
+    bool connected;
+    Peer peer;
+    Message error;
+};
+
 }
 
 
@@ -41,6 +41,7 @@ SOFTWARE.
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <memory>
 #include "Peer.hpp"
 
 #include <functional> 
@@ -84,11 +85,16 @@ class TcpNode
 public:
 
     /**
-     * Constructor with optional IP version.
+     * Constructor with optional IP version
+     * and RunMode.
      * @ipv Describes which IP version will
      *    be used when listening.
+     * @mode RunMode::POLL creates a TcpNode
+     *    without threads, that only works
+     *    inside of poll().
     */
-    TcpNode(IpVersion ipv = IpVersion::ANY);
+    TcpNode(IpVersion ipv = IpVersion::ANY, 
+            RunMode mode = RunMode::THREADS);
 
     /**
       Copying is forbidden.
@@ -138,21 +144,275 @@ public:
      * Connect this TcpNode to the specified IP and
      * port. This function will automatically
      * choose between IPv4 and IPv6.
-     * @param[in] ipaddr IP address of remote peer
+     * Host names are resolved by a pool of
+     * background threads first (see 
+     * setResolveTimeout()).
+     * All addresses of a host are tried, taking
+     * turns between IPv6 and IPv4. The next one
+     * starts when the previous attempt fails or
+     * after 250 ms, and the first connection
+     * that succeeds is kept.
+     * @param[in] ipaddr IP address or host name of remote peer
      * @param[in] port Port of remote peer
     */
     virtual void connectTo(const std::string &ipaddr,
                            uint16_t port);
 
+    /**
+     * Same as connectTo() above but keeps
+     * the connection alive as described by
+     * policy. A reconnected peer keeps its id
+     * and onReconnect() is called instead of
+     * onConnect(). Closing the connection with
+     * disconnectPeer() ends the reconnecting.
+     * @param[in] ipaddr IP address or host name of remote peer
+     * @param[in] port Port of remote peer
+     * @param[in] policy When and how to reconnect
+    */
+    virtual void connectTo(const std::string &ipaddr,
+                           uint16_t port,
+                           const ReconnectPolicy &policy);
+
+    /**
+     * Same as connectTo() above but sends
+     * first_data with TCP Fast Open. If the
+     * remote is known and supports it, the data
+     * travels with the connection request and
+     * saves a round trip. Otherwise it is sent
+     * as soon as the connection is established,
+     * before any other data.
+     * The remote may receive the data twice if
+     * the connection request is repeated, so
+     * it should be safe to process twice.
+     * @param[in] ipaddr IP address or host name of remote peer
+     * @param[in] port Port of remote peer
+     * @param[in] first_data Data to send first
+    */
+    virtual void connectTo(const std::string &ipaddr,
+                           uint16_t port,
+                           const std::vector<uint8_t> &first_data);
+
+    /**
+     * Connect to many endpoints at once, e.g. all
+     * nodes of a cluster. The endpoints are connected
+     * in parallel like by connectTo(), and onConnect()
+     * or onConnectError() are called for each of them.
+     * Once every endpoint is either connected or
+     * failed, completion is called with one result
+     * per endpoint in the order of endpoints.
+     * @param[in] endpoints Remotes to connect to
+     * @param[in] completion Called with all results
+    */
+    void connectToAll(
+        const std::vector<Endpoint> &endpoints,
+        std::function<void(std::vector<ConnectResult> results)> completion);
+
+    /**
+     * Get a connection to host and port from
+     * the connection pool. Of the pooled
+     * connections to that endpoint, the one
+     * with the fewest queued bytes is returned.
+     * A new connection is opened in the
+     * background if there is none, if all are
+     * busy sending or if fewer than the minimum
+     * are open, as long as the maximum is not
+     * reached (see setPoolLimits()). onConnect()
+     * reports when it is ready.
+     * @param[in] host IP address or host name of remote
+     * @param[in] port Port of remote
+     * @return A pooled Peer or an invalid
+     *         Peer if none is connected yet
+    */
+    virtual Peer pooledPeer(const std::string &host,
+                            uint16_t port);
+
+    /**
+     * Configure the connection pool used by
+     * pooledPeer(). Pooled connections that
+     * were not handed out for idle_timeout_ms
+     * and have nothing left to send are closed,
+     * as long as more than min_per_endpoint are
+     * open. By default there is at most one
+     * connection per endpoint, no minimum and an
+     * idle timeout of 60 s.
+     * @param[in] min_per_endpoint Connections kept open
+     * @param[in] max_per_endpoint Upper bound of connections
+     * @param[in] idle_timeout_ms Idle time before a connection
+     *                            is closed. 0 keeps them open.
+    */
+    void setPoolLimits(
+        size_t min_per_endpoint,
+        size_t max_per_endpoint,
+        int idle_timeout_ms);
+
     /**
      * Send vector of chars to specified peer.
+     * Queued data of a higher priority is sent
+     * first, but a message that has started to
+     * go out is always finished before the next
+     * one starts. Lower priorities are not starved:
+     * after 16 messages of higher priorities the
+     * oldest waiting one of a lower priority is sent.
+     * Data that is not URGENT is refused while the
+     * send queue of the peer holds at least as many
+     * bytes as the high watermark (see setSendWatermarks()).
      * @param[in] pr The receiver of your data
      * @param[in] dat The data you want to transmit
+     * @param[in] priority Priority class of the data
+     * @return Was the data queued for sending?
     */
-    virtual void sendData(
+    virtual bool sendData(
         const Peer &pr, 
-        const std::vector<uint8_t> &dat);
+        const std::vector<uint8_t> &dat,
+        Priority priority = Priority::NORMAL);
 
+    /**
+     * Send (a part of) a file to specified peer.
+     * The file is streamed straight from disk
+     * to the connection (sendfile on Linux), so it
+     * is never loaded into memory as a whole.
+     * It leaves after everything of the same
+     * priority that was queued for the peer before
+     * and onSend() reports the progress.
+     * @param[in] pr The receiver of the file
+     * @param[in] path Path of the file
+     * @param[in] offset Position of the first byte to send
+     * @param[in] length Number of bytes to send. 0 sends
+     *                   everything from offset to the end.
+     * @param[in] priority Priority class of the file
+     * @return Was the file queued for sending?
+    */
+    virtual bool sendFile(
+        const Peer &pr,
+        const std::string &path,
+        uint64_t offset = 0,
+        uint64_t length = 0,
+        Priority priority = Priority::NORMAL);
+
+    /**
+     * Same as sendFile() above but takes an
+     * already opened file. TcpNode works on a
+     * duplicate of the descriptor, so it can be
+     * closed right after this call.
+     * @param[in] pr The receiver of the file
+     * @param[in] fd Descriptor of a file opened for reading
+     * @param[in] offset Position of the first byte to send
+     * @param[in] length Number of bytes to send. 0 sends
+     *                   everything from offset to the end.
+     * @param[in] priority Priority class of the file
+     * @return Was the file queued for sending?
+    */
+    virtual bool sendFile(
+        const Peer &pr,
+        int fd,
+        uint64_t offset = 0,
+        uint64_t length = 0,
+        Priority priority = Priority::NORMAL);
+
+    /**
+     * Same as sendData() above but reports when
+     * the data has left the node. completion is
+     * called exactly once with success set to true
+     * once the last byte was handed to the operating
+     * system, or with false if the data was refused
+     * or dropped because the peer went away.
+     * It is called from a thread of TcpNode (or
+     * right away if the data is refused), and not
+     * at all when the TcpNode is destroyed first.
+     * @param[in] pr The receiver of your data
+     * @param[in] dat The data you want to transmit
+     * @param[in] completion Called when the data is
+     *                       sent or dropped
+     * @param[in] priority Priority class of the data
+     * @return Was the data queued for sending?
+    */
+    virtual bool sendData(
+        const Peer &pr,
+        const std::vector<uint8_t> &dat,
+        SendCompletion completion,
+        Priority priority = Priority::NORMAL);
+
+    /**
+     * Same as sendFile() above but reports when
+     * the file has left the node, like the
+     * sendData() overload with a completion.
+    */
+    virtual bool sendFile(
+        const Peer &pr,
+        const std::string &path,
+        SendCompletion completion,
+        uint64_t offset = 0,
+        uint64_t length = 0,
+        Priority priority = Priority::NORMAL);
+
+    /**
+     * Same as sendFile() above for an already
+     * opened file but reports when the file has
+     * left the node, like the sendData() overload
+     * with a completion.
+    */
+    virtual bool sendFile(
+        const Peer &pr,
+        int fd,
+        SendCompletion completion,
+        uint64_t offset = 0,
+        uint64_t length = 0,
+        Priority priority = Priority::NORMAL);
+
+
+    /**
+     * Limit the amount of data that can wait
+     * in the send queue of each peer.
+     * While a queue holds at least high bytes
+     * sendData() refuses new data for that peer
+     * unless it is URGENT.
+     * Once such a queue has drained to low bytes
+     * or less, onWritable() is called. Files
+     * queued by sendFile() do not count since
+     * they are not held in memory.
+     * By default the queues are unlimited.
+     * @param[in] low Low watermark in bytes
+     * @param[in] high High watermark in bytes
+    */
+    void setSendWatermarks(size_t low, size_t high);
+
+    /**
+     * Shows how many bytes of data are
+     * still waiting to be sent to a peer.
+     * @param[in] pr The peer of interest
+     * @return Queued bytes
+    */
+    size_t queuedBytes(const Peer &pr);
+
+    /**
+     * Let small messages to a peer pile up
+     * before they are sent, so they leave in
+     * fewer and fuller segments. Data is held
+     * back for window_us microseconds after the
+     * first message was queued, until max_bytes
+     * are queued, until URGENT data is queued or
+     * until flush() is called. The socket is
+     * corked while the messages are written
+     * (TCP_CORK on Linux).
+     * The window is waited for with millisecond
+     * precision. Coalescing is off by default.
+     * @param[in] pr The peer of interest
+     * @param[in] window_us Longest time data is
+     *                      held back. 0 turns
+     *                      coalescing off.
+     * @param[in] max_bytes Amount of queued data that
+     *                      is sent right away. 0 means
+     *                      no limit.
+    */
+    void setCoalescing(const Peer &pr, uint32_t window_us, size_t max_bytes = 0);
+
+    /**
+     * Send data that is held back by
+     * coalescing (see setCoalescing())
+     * to a peer right away.
+     * @param[in] pr The peer of interest
+    */
+    void flush(const Peer &pr);
 
     /**
      * @return Listen port that was set by
@@ -185,6 +445,19 @@ public:
     */
     PeerList allPeers();
 
+    /**
+      * Like allPeers() but without copying. All
+      * callers share the same immutable list until
+      * a Peer connects or is removed, so it is
+      * cheap to call often, even with many Peers.
+      * Only which Peers are in the list is frozen.
+      * Each Peer still shows its current state,
+      * so one in the list may already be
+      * disconnected.
+      * @return All currently connected Peers.
+    */
+    std::shared_ptr<const PeerList> peerSnapshot();
+
     /**
      * Returns latest Peer which
      * connected to this TcpNode
@@ -209,9 +482,65 @@ public:
     */
     void setConnectTimeout(int ms);
 
+    /**
+     * Returns current timeout for resolving
+     * host names in milliseconds.
+    */
+    int resolveTimeout();
+
+    /**
+      * Set how long resolving the host name
+      * passed to connectTo() may take. Host
+      * names are resolved in the background,
+      * literal IP addresses are not resolved.
+      * If resolving fails or takes too long
+      * onConnectError() is called.
+      * @param[in] ms Timeout in milliseconds
+    */
+    void setResolveTimeout(int ms);
+
+    /**
+      * Configure the cache of resolved host names.
+      * Addresses of a host are reused for ttl_ms,
+      * hosts that do not exist are remembered for
+      * negative_ttl_ms. Other failures are not cached.
+      * The cache holds at most max_entries hosts and
+      * drops the least recently used one first.
+      * By default addresses are kept for 30 s,
+      * unknown hosts for 5 s and 1024 entries.
+      * @param[in] ttl_ms Lifetime of addresses. 0 disables
+      *                   caching of addresses.
+      * @param[in] negative_ttl_ms Lifetime of unknown hosts.
+      *                            0 disables negative caching.
+      * @param[in] max_entries Size bound of the cache
+    */
+    void setResolveCache(int ttl_ms, int negative_ttl_ms, size_t max_entries);
+
+    /**
+      * Let the listener accept data that comes
+      * with a connection request (TCP Fast Open).
+      * Takes effect with the next doListen().
+      * It is silently disabled if the system
+      * does not support it.
+      * @param[in] queue_length How many of those
+      *            connections may wait to be
+      *            accepted. 0 disables it.
+    */
+    void setFastOpen(int queue_length);
+
+    /**
+      * Forget the cached addresses of a host, e.g.
+      * after it moved. Without argument the whole
+      * cache is cleared.
+      * @param[in] host Host name to forget
+    */
+    void invalidateResolveCache(const std::string &host = "");
+
     /**
       * To reduce CPU load, TcpNode sleeps for a few
       * milliseconds after each loop in its background threads.
+      * An idle listen thread wakes up as soon as a socket
+      * is readable and after the sleep time at the latest.
       * The default sleep time is 10 milliseconds.
       * Use this function to set your
       * preferred sleep time
@@ -219,13 +548,120 @@ public:
     */
     void setSleepTime(int ms);
 
+    /**
+      * Busy polling for lowest latency at the
+      * cost of CPU time. The listen and send
+      * threads spin for up to spin_us microseconds
+      * after their last work instead of blocking
+      * right away, and SO_BUSY_POLL
+      * (and SO_PREFER_BUSY_POLL if available) is
+      * set to spin_us on the sockets of all Peers.
+      * Best used with threads pinned to their own
+      * CPUs, see setThreadOptions().
+      * Raising SO_BUSY_POLL above net.core.busy_read
+      * needs CAP_NET_ADMIN, the spinning works
+      * without it.
+      * @param[in] spin_us Spin budget in microseconds,
+      *            0 disables busy polling (the default).
+    */
+    void setBusyPoll(uint32_t spin_us);
+
+    /**
+      * Run callbacks on a pool of worker threads
+      * instead of the threads of TcpNode, so slow
+      * callbacks do not hold up sending and receiving.
+      * The callbacks of one Peer (onReceive(), onSent(),
+      * onDisconnect(), send completions, ...) still run
+      * one after another in the order they happened.
+      * Callbacks of different Peers may run in parallel.
+      * Callbacks that do not belong to a Peer, such as
+      * onListenError(), always run on TcpNode's threads.
+      * Call this before connecting or listening, and not
+      * from within a callback.
+      * @param[in] worker_count Number of worker threads.
+      *            0 runs callbacks on TcpNode's threads
+      *            (the default).
+    */
+    void setCallbackWorkers(size_t worker_count);
+
+    /**
+      * Pins a kind of thread of TcpNode to
+      * some CPUs and/or runs it with SCHED_FIFO,
+      * for example to keep it off the CPUs of
+      * latency critical application threads.
+      * Applies to threads that are running and
+      * to those started later. The threads are
+      * named spw-listen, spw-connect, spw-send,
+      * spw-worker-<n> and spw-resolve-<n>, so they
+      * can be told apart in top or perf.
+      * Options that cannot be applied, like
+      * SCHED_FIFO without the permission for it,
+      * leave the thread as it was. For threads
+      * that are already running this is reported
+      * by the return value. Threads started later
+      * apply the options on a best effort basis.
+      * @param[in] thread The kind of thread
+      * @param[in] options CPUs and priority
+      * @return false if a running thread did not
+      *         take all of the options
+    */
+    bool setThreadOptions(NodeThread thread, const ThreadOptions &options);
+
+    /**
+      * Does the work of a TcpNode created with
+      * RunMode::POLL: listening, accepting,
+      * connecting, receiving, sending and all
+      * callbacks run inside this function on
+      * the calling thread. Waits until there
+      * is something to do or timeout_ms passed,
+      * then does everything that is ready.
+      * Call it in a loop from one thread.
+      * Host names are still looked up in the
+      * background, connect to IP addresses to
+      * avoid that.
+      * @param[in] timeout_ms Longest wait in
+      *            milliseconds. 0 does not wait,
+      *            -1 waits until something happens.
+    */
+    void poll(int timeout_ms);
+
+    /**
+      * For running a TcpNode created with RunMode::POLL
+      * inside an existing event loop. The returned
+      * descriptor becomes readable whenever the
+      * TcpNode has something to do. Watch it for
+      * reading (epoll, poll, select, ...) and call
+      * processEvents() when it is readable or
+      * pollTimeout() has passed.
+      * @return The descriptor, or -1 if the TcpNode
+      *         was not created with RunMode::POLL
+      *         or the platform is not Linux.
+    */
+    int pollDescriptor();
+
+    /**
+      * How long the event loop may wait for
+      * pollDescriptor() before it has to call
+      * processEvents() anyway, for example
+      * to time out a connection attempt.
+      * @return Timeout in milliseconds, -1 if
+      *         there is no timeout.
+    */
+    int pollTimeout();
+
+    /**
+      * Does everything that is ready without
+      * waiting. Same as poll(0).
+    */
+    void processEvents();
+
     /**
       * Specifies which function is called
       * when TcpNode starts listening.
       * @param[in] cb Started listening callback function
     */
     void onStartedListening(
-        std::function<void(uint16_t)> callback);
+        ListenCallback callback);
 
     /**
       * Specifies which function is called when
@@ -233,7 +669,7 @@ public:
       * @param[in] cb Stopped listening callback function.
     */
     void onStoppedListening(
-        std::function<void()> callback);
+        StoppedCallback callback);
 
     /**
      * Specifies which function
@@ -242,7 +678,7 @@ public:
      * @param[in] cb Accept callback function
     */
     void onAccept(
-        std::function<void(Peer pr)> callback);
+        PeerCallback callback);
 
     /**
      * Specifies which function is called
@@ -251,8 +687,7 @@ public:
      * @param[in] cb Receive callback function
     */
     void onReceive(
-        std::function<void(Peer pr, 
-                std::vector<uint8_t> bytes)> callback);
+        ReceiveCallback callback);
 
     /**
      * Specifies which function is called
@@ -261,7 +696,7 @@ public:
      * @param[in] cb Disconnect callback function
     */
     void onDisconnect(
-        std::function<void(Peer pr)> callback);
+        PeerCallback callback);
 
 
     /**
@@ -271,7 +706,7 @@ public:
       * @param[in] cb Connection closed callback function
     */
     void onClosedConnection(
-        std::function<void(Peer pr)> cb);
+        PeerCallback cb);
 
     /**
      * Specifies which function is called
@@ -281,7 +716,7 @@ public:
      * @param[in] cb Connect callback function
     */
     void onConnect(
-        std::function<void(Peer pr)> callback);
+        PeerCallback callback);
 
     /**
      * Specifies which funciton is called
@@ -290,7 +725,26 @@ public:
      * @param[in] callback Send callback function
     */
     void onSend(
-        std::function<void(Peer pr, size_t amount)> callback);
+        SentCallback callback);
+
+    /**
+     * Specifies which function is called
+     * when the send queue of a peer, which
+     * refused data before, has drained below
+     * the low watermark.
+     * @param[in] callback Writable callback function
+    */
+    void onWritable(
+        PeerCallback callback);
+
+    /**
+     * Specifies which function is called
+     * when a peer that was connected with
+     * a ReconnectPolicy is connected again.
+     * @param[in] callback Reconnect callback function
+    */
+    void onReconnect(
+        PeerCallback callback);
 
     /**
      * Specifies which function is called
@@ -300,7 +754,7 @@ public:
      * @param[in] callback Connect callback function
     */
     void onListenError(
-        std::function<void (Message msg)> callback);
+        ErrorCallback callback);
 
     /**
     * Specifies which function is called
@@ -310,7 +764,7 @@ public:
     * @param[in] callback Connect callback function
     */
     void onSendError(
-        std::function<void (Message msg)> callback);
+        ErrorCallback callback);
     /**
     * Specifies which function is called
     * when an error occurrs while TcpNode
@@ -318,7 +772,7 @@ public:
     * @param[in] callback Connect callback function
     */
     void onConnectError(
-        std::function<void (Message msg)> callback);
+        ErrorCallback callback);
 
     /**
       * Specifies which function is called
@@ -327,7 +781,7 @@ public:
       * @param[in] callback Faulty connection callback function.
     */
     void onFaultyConnectionClosed(
-        std::function<void(Peer pr, Message err)> callback);
+        PeerErrorCallback callback);
 
 private:
     TcpNodePrivate *m_private = nullptr;
@@ -22,8 +22,10 @@ SOFTWARE.
 #ifndef SPW_COMMON_HPP_
 #define SPW_COMMON_HPP_
 
+#include <cstdint>
 #include <unordered_map>
 #include <string>
+#include <vector>
 
 //Windows specific DLL import/export markers
 #ifdef _WIN32
@@ -51,6 +53,86 @@ struct Message
 
 enum class IpVersion {ANY, IPV4, IPV6};
 
+/**
+ * How TcpNode gets its work done.
+ * THREADS: TcpNode starts its own threads
+ * for listening, connecting and sending.
+ * POLL: TcpNode starts no threads, all work
+ * and all callbacks run inside TcpNode::poll()
+ * on the thread of the caller.
+*/
+enum class RunMode {THREADS, POLL};
+
+/**
+ * The kinds of threads TcpNode starts, see
+ * TcpNode::setThreadOptions().
+*/
+enum class NodeThread {LISTEN, CONNECT, SEND, CALLBACK_WORKERS, RESOLVER};
+
+/**
+ * @struct ThreadOptions
+ * Where and how a thread of TcpNode runs.
+ * cpus lists the CPUs the thread may run on,
+ * an empty list allows all of them.
+ * A fifo_priority above 0 runs the thread with
+ * SCHED_FIFO at that priority (1 - 99), which
+ * needs CAP_SYS_NICE or an RLIMIT_RTPRIO.
+*/
+struct ThreadOptions
+{
+    std::vector<int> cpus;
+    int fifo_priority = 0;
+};
+
+/**
+ * @struct Endpoint
+ * Host name or IP address and port
+ * of a remote.
+*/
+struct Endpoint
+{
+    std::string host;
+    uint16_t port;
+};
+
+/**
+ * Priority classes for outgoing data.
+ * URGENT data is sent before NORMAL data
+ * and NORMAL data before BULK data.
+*/
+enum class Priority {URGENT, NORMAL, BULK};
+
+/**
+ * @struct ReconnectPolicy
+ * Tells TcpNode to keep a connection made by
+ * connectTo() alive. Passing a policy to
+ * connectTo() is what turns reconnecting on;
+ * connections made in any other way are never
+ * reconnected. If the remote goes away
+ * or cannot be reached, TcpNode connects again
+ * after a delay of initial_delay_ms multiplied
+ * by multiplier once for every failed attempt
+ * in a row, up to max_delay_ms. A random
+ * part of up to jitter times the delay is taken
+ * off, so many nodes do not reconnect in step.
+ * After max_attempts failed attempts in a row
+ * TcpNode gives up (0 never gives up).
+ * With replay_queue set, data that was still
+ * queued for the remote is sent once it is
+ * reconnected, and sendData() keeps queueing
+ * while it is reconnecting. Otherwise that
+ * data is dropped.
+*/
+struct ReconnectPolicy
+{
+    int initial_delay_ms = 100;
+    int max_delay_ms = 30000;
+    double multiplier = 2.0;
+    double jitter = 0.5;
+    int max_attempts = 0;
+    bool replay_queue = false;
+};
+
 const std::string g_version_string = "1.0.1";
 
 /**
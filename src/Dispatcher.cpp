@@ -0,0 +1,135 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "Dispatcher.hpp"
+#include "ThreadSetup.hpp"
+
+namespace spw
+{
+
+using Lock = std::unique_lock<std::mutex>;
+
+Dispatcher::Dispatcher(size_t workerCount, const ThreadOptions &options)
+{
+    if(workerCount == 0)
+    {
+        workerCount = 1;
+    }
+
+    for(size_t i = 0; i < workerCount; ++i)
+    {
+        m_workers.emplace_back(new Worker());
+    }
+
+    for(size_t i = 0; i < m_workers.size(); ++i)
+    {
+        Worker *worker = m_workers[i].get();
+        worker->thread = startThread(
+            "spw-worker-" + std::to_string(i),
+            options,
+            [this, worker](){_workerJob(*worker);});
+    }
+}
+
+Dispatcher::~Dispatcher()
+{
+    for(auto &worker : m_workers)
+    {
+        Lock lck(worker->access);
+        worker->stopping = true;
+        lck.unlock();
+        worker->available.notify_one();
+    }
+
+    for(auto &worker : m_workers)
+    {
+        if(worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+}
+
+void Dispatcher::post(uint64_t key, std::function<void()> task)
+{
+    Worker &worker = *m_workers[key % m_workers.size()];
+    Lock lck(worker.access);
+    bool was_empty = worker.tasks.empty();
+    worker.tasks.push_back(std::move(task));
+    lck.unlock();
+
+    if(was_empty)
+    {
+        worker.available.notify_one();
+    }
+}
+
+size_t Dispatcher::workerCount() const
+{
+    return m_workers.size();
+}
+
+bool Dispatcher::setThreadOptions(const ThreadOptions &options)
+{
+    bool applied = true;
+
+    for(size_t i = 0; i < m_workers.size(); ++i)
+    {
+        applied = setupThread(m_workers[i]->thread,
+            "spw-worker-" + std::to_string(i), options) && applied;
+    }
+
+    return applied;
+}
+
+void Dispatcher::_workerJob(Worker &worker)
+{
+    Lock lck(worker.access);
+
+    while(true)
+    {
+        worker.available.wait(lck, [&worker](){
+            return !worker.tasks.empty() || worker.stopping;
+        });
+
+        if(worker.tasks.empty())
+        {
+            break;
+        }
+
+        //Take everything at once, so posting
+        //does not wait while tasks run.
+        std::deque<std::function<void()>> tasks;
+        tasks.swap(worker.tasks);
+        lck.unlock();
+
+        for(auto &task : tasks)
+        {
+            task();
+        }
+
+        lck.lock();
+    }
+}
+
+}
@@ -0,0 +1,90 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef SPW_DISPATCHER_HPP_
+#define SPW_DISPATCHER_HPP_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../include/common.hpp"
+
+namespace spw
+{
+
+/**
+ * Runs tasks on a pool of worker threads.
+ * Tasks with the same key always go to the
+ * same worker and run in the order they were
+ * posted. Tasks with different keys may run
+ * in parallel.
+ * The destructor runs the tasks that are
+ * still queued before it returns. It must
+ * not be called by one of the workers.
+*/
+class Dispatcher
+{
+public:
+
+    explicit Dispatcher(
+        size_t workerCount,
+        const ThreadOptions &options = ThreadOptions());
+    ~Dispatcher();
+
+    Dispatcher(const Dispatcher&) = delete;
+    Dispatcher& operator=(const Dispatcher&) = delete;
+
+    void post(uint64_t key, std::function<void()> task);
+    size_t workerCount() const;
+
+    /**
+     * Applies options to all workers.
+     * Workers are named spw-worker-<n>.
+     * @return Could the options be applied?
+    */
+    bool setThreadOptions(const ThreadOptions &options);
+
+private:
+
+    struct Worker
+    {
+        std::mutex access;
+        std::condition_variable available;
+        std::deque<std::function<void()>> tasks;
+        bool stopping = false;
+        std::thread thread;
+    };
+
+    void _workerJob(Worker &worker);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+};
+
+}
+
+#endif // SPW_DISPATCHER_HPP_
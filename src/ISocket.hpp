@@ -56,6 +56,39 @@ public:
             const std::string &ip, 
             uint16_t port) = 0;
 
+    //Non-blocking variant of connect(). Returns false
+    //if the attempt failed right away. Otherwise the 
+    //socket is connected or socketNumber() becomes
+    //writable once the attempt is over, which
+    //finishConnect() then evaluates. It returns false
+    //with getLastErrno() == 0 while still connecting.
+    //By default both fall back to connect().
+    virtual bool startConnect(
+            const std::string &ip,
+            uint16_t port)
+    {
+        return connect(ip, port);
+    }
+
+    //Like startConnect() but hands data to TCP Fast
+    //Open. bytesSent tells how much of it went out
+    //with the SYN, the rest has to be sent normally.
+    virtual bool startFastOpenConnect(
+            const std::string &ip,
+            uint16_t port,
+            const std::vector<uint8_t> &data,
+            size_t &bytesSent)
+    {
+        (void)data;
+        bytesSent = 0;
+        return startConnect(ip, port);
+    }
+
+    virtual bool finishConnect()
+    {
+        return isConnected();
+    }
+
     virtual void close() = 0;
 
     virtual ISocket* accept() = 0;
@@ -66,6 +99,36 @@ public:
     virtual size_t send(
             const std::vector<uint8_t> &dataToSend) = 0;
 
+    //Sends length bytes starting at data. Sockets
+    //that cannot do this without a copy fall
+    //back to send().
+    virtual size_t sendBytes(const uint8_t *data, size_t length)
+    {
+        return send(std::vector<uint8_t>(data, data + length));
+    }
+
+    virtual size_t sendFile(
+            int fileDescriptor,
+            uint64_t offset,
+            size_t length) = 0;
+
+    virtual bool setCorked(bool corked) = 0;
+
+    //Queue length for TCP Fast Open on the next
+    //listen(). 0 disables it.
+    virtual void setFastOpenQueue(int queueLength)
+    {
+        (void)queueLength;
+    }
+
+    //Busy poll the device queue for up to usec
+    //microseconds when receiving. 0 disables it.
+    virtual bool setBusyPoll(uint32_t usec)
+    {
+        (void)usec;
+        return false;
+    }
+
     virtual int32_t socketNumber() = 0;
     virtual bool isListener() = 0;
     virtual uint16_t listenPort() = 0;
@@ -79,6 +142,8 @@ public:
     virtual size_t receiveBufferSize() = 0;
     virtual void setSleepTime(uint32_t milliseconds) = 0;
     virtual uint32_t sleepTime() = 0;
+    //Both return the error of the last failed call
+    //and clear it, so each error is read only once.
     virtual int getLastErrno() = 0;
     virtual std::string getLastErrnoString() = 0;
 
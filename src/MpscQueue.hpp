@@ -0,0 +1,134 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef SPW_MPSC_QUEUE_HPP_
+#define SPW_MPSC_QUEUE_HPP_
+
+#include <atomic>
+#include <utility>
+
+namespace spw
+{
+
+/**
+ * Unbounded queue that many threads may push
+ * to without locking while one thread pops.
+ * Each push links a new node behind the last
+ * one with a single atomic exchange (Vyukov's
+ * intrusive MPSC queue). A node that was just
+ * exchanged in may not be linked yet, then
+ * pop() sees the queue as empty until it is.
+*/
+template<typename T>
+class MpscQueue
+{
+public:
+
+    MpscQueue() : m_head(&m_stub), m_tail(&m_stub)
+    {
+    }
+
+    ~MpscQueue()
+    {
+        T value;
+        while(pop(value))
+        {
+        }
+
+        if(m_tail != &m_stub)
+        {
+            delete m_tail;
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /**
+     * May be called by any thread.
+     * Linking is sequentially consistent, so a
+     * producer that checks a flag of the consumer
+     * after push() and a consumer that checks
+     * empty() after setting it cannot both miss.
+    */
+    void push(T &&value)
+    {
+        Node *node = new Node(std::move(value));
+        Node *prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node);
+    }
+
+    /**
+     * May only be called by the consumer.
+     * Returns false if nothing can be taken.
+    */
+    bool pop(T &value)
+    {
+        Node *tail = m_tail;
+        Node *next = tail->next.load(std::memory_order_acquire);
+
+        if(next == nullptr)
+        {
+            return false;
+        }
+
+        value = std::move(next->value);
+        m_tail = next;
+
+        //The node that was taken is the new
+        //stub, its value is not used anymore.
+        if(tail != &m_stub)
+        {
+            delete tail;
+        }
+
+        return true;
+    }
+
+    /**
+     * May only be called by the consumer.
+    */
+    bool empty() const
+    {
+        return m_tail->next.load() == nullptr;
+    }
+
+private:
+
+    struct Node
+    {
+        Node() : next(nullptr) {}
+        explicit Node(T &&val) : next(nullptr), value(std::move(val)) {}
+
+        std::atomic<Node*> next;
+        T value;
+    };
+
+    Node m_stub;
+    std::atomic<Node*> m_head;
+    Node *m_tail;
+};
+
+}
+
+#endif // SPW_MPSC_QUEUE_HPP_
@@ -31,40 +31,66 @@ SOFTWARE.
 namespace spw
 {
 
-Peer::Peer() : m_private(new PeerPrivate())
+Peer::Peer()
 {
 
 }
 
-Peer::Peer(const Peer &other)
+Peer::Peer(PeerPrivate *state) : m_private(state)
 {
-    delete m_private;
-    m_private = new PeerPrivate();
-    *m_private = *other.m_private;
+
+}
+
+Peer::Peer(const Peer &other) : m_private(other.m_private)
+{
+    if(m_private)
+    {
+        m_private->addReference();
+    }
 }
 
 Peer& Peer::operator=(const Peer &other)
 {
-    delete m_private;
-    m_private = new PeerPrivate();
-    *m_private = *other.m_private;
+    if(m_private != other.m_private)
+    {
+        if(other.m_private)
+        {
+            other.m_private->addReference();
+        }
+        _release();
+        m_private = other.m_private;
+    }
     return *this;
 }
 
-Peer::Peer(Peer&& other) : m_private(nullptr)
+Peer::Peer(Peer&& other) : m_private(other.m_private)
 {
-    m_private = other.m_private;
     other.m_private = nullptr;
 }
 
+Peer& Peer::operator=(Peer &&other)
+{
+    if(this != &other)
+    {
+        _release();
+        m_private = other.m_private;
+        other.m_private = nullptr;
+    }
+    return *this;
+}
 
 Peer::~Peer()
 {
-    if(m_private)
+    _release();
+}
+
+void Peer::_release()
+{
+    if(m_private && m_private->removeReference())
     {
         delete m_private;
-        m_private = nullptr;
     }
+    m_private = nullptr;
 }
 
 uint64_t Peer::id() const
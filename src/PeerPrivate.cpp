@@ -39,6 +39,16 @@ PeerPrivate::~PeerPrivate()
 
 }
 
+void PeerPrivate::addReference()
+{
+    m_references.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool PeerPrivate::removeReference()
+{
+    return m_references.fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
+
 uint64_t PeerPrivate::id()
 {
     return m_connection_id;
@@ -64,20 +74,6 @@ bool PeerPrivate::isValid()
     return m_valid;
 }
 
-PeerPrivate& PeerPrivate::operator=(const PeerPrivate &other)
-{
-    m_connection_id = other.m_connection_id;
-    m_ip_address = other.m_ip_address;
-    m_port_number = other.m_port_number;
-    m_hostname = other.m_hostname;
-    m_valid = other.m_valid;
-    m_to_be_deleted = other.m_to_be_deleted;
-    m_socket = other.m_socket;
-    m_disconn = other.m_disconn;
-    m_errmsg = other.m_errmsg;
-    return *this;
-}
-
 bool PeerPrivate::operator==(const PeerPrivate &other)
 {
     return m_connection_id == other.m_connection_id &&
@@ -136,23 +132,36 @@ DisconnectType PeerPrivate::disconnectType()
 
 void PeerPrivate::destroySocket()
 {
-    if(m_socket)
+    ISocket *socket = m_socket.exchange(nullptr);
+
+    if(socket)
     {
-        m_socket->close();
-        delete m_socket;
-        m_socket = nullptr;
+        socket->close();
+        delete socket;
     }
 }
 
 void PeerPrivate::setErrorMessage(Message err)
 {
+    std::lock_guard<std::mutex> lck(m_errmsg_access);
     m_errmsg = err;
 }
 
 Message PeerPrivate::getErrorMessage()
 {
+    std::lock_guard<std::mutex> lck(m_errmsg_access);
     return m_errmsg;
 }
 
+void PeerPrivate::setSendState(std::shared_ptr<SendState> state)
+{
+    m_send_state = state;
+}
+
+std::shared_ptr<SendState> PeerPrivate::sendState()
+{
+    return m_send_state;
+}
+
 
 }
@@ -23,7 +23,10 @@ SOFTWARE.
 #ifndef SPW_PEER_PRIVATE_HPP_
 #define SPW_PEER_PRIVATE_HPP_
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 
 #include "../include/common.hpp"
@@ -39,6 +42,30 @@ enum DisconnectType {
     PEER_WAS_DISCONNECTED_DUE_TO_ERROR
 };
 
+/**
+ * What sendData() needs to know about a Peer
+ * without locking. It is shared by all copies
+ * of the Peer and kept while it reconnects.
+ * open is cleared when the Peer is gone.
+ * queued_bytes counts the bytes that were
+ * accepted but not written yet.
+ * notify_writable is set when sendData() was
+ * rejected because of the high watermark.
+*/
+struct SendState
+{
+    std::atomic<bool> open{true};
+    std::atomic<size_t> queued_bytes{0};
+    std::atomic<bool> notify_writable{false};
+};
+
+/**
+ * State of a Peer that all of its copies
+ * share. Address, port and host name are set
+ * once before the Peer is handed out, the
+ * rest can change while it is shared and
+ * is therefore safe to use from any thread.
+*/
 class PeerPrivate
 {
 
@@ -48,15 +75,23 @@ friend class TcpNodePrivate;
 public:
 
     PeerPrivate();
+    PeerPrivate(const PeerPrivate &other) = delete;
+    PeerPrivate& operator=(const PeerPrivate &other) = delete;
     virtual ~PeerPrivate();
 
+    void addReference();
+
+    /**
+     * @return Was this the last reference?
+    */
+    bool removeReference();
+
     uint64_t id();
     std::string ipAddress();
     uint16_t port();
     std::string hostName();
     bool isValid();
 
-    PeerPrivate& operator=(const PeerPrivate &other);
     bool operator==(const PeerPrivate &other);
     explicit operator bool();
 
@@ -79,18 +114,23 @@ protected:
     void destroySocket();
     void setErrorMessage(Message err);
     Message getErrorMessage();
+    void setSendState(std::shared_ptr<SendState> state);
+    std::shared_ptr<SendState> sendState();
 
 private:
 
+    std::atomic<size_t> m_references{1};
     uint64_t m_connection_id;
     std::string m_ip_address;
     uint16_t m_port_number;
     std::string m_hostname;
-    bool m_valid = false;
-    bool m_to_be_deleted = false;
-    ISocket *m_socket = nullptr;
-    DisconnectType m_disconn = PEER_DISCONNECTED_THEMSELF;
+    std::atomic<bool> m_valid{false};
+    std::atomic<bool> m_to_be_deleted{false};
+    std::atomic<ISocket*> m_socket{nullptr};
+    std::atomic<DisconnectType> m_disconn{PEER_DISCONNECTED_THEMSELF};
+    std::mutex m_errmsg_access;
     Message m_errmsg;
+    std::shared_ptr<SendState> m_send_state;
 
 };
 
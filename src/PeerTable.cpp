@@ -0,0 +1,157 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "PeerTable.hpp"
+
+namespace spw
+{
+
+using Lock = std::unique_lock<std::mutex>;
+
+PeerTable::PeerTable() : m_size(0), m_version(0)
+{
+
+}
+
+void PeerTable::insert(const Peer &pr)
+{
+    Shard &shard = _shardOf(pr.id());
+    Lock lck(shard.access);
+
+    if(shard.peers.insert({pr.id(), pr}).second)
+    {
+        ++m_size;
+        ++m_version;
+    }
+}
+
+void PeerTable::erase(uint64_t peer_id)
+{
+    Shard &shard = _shardOf(peer_id);
+    Lock lck(shard.access);
+
+    if(shard.peers.erase(peer_id) > 0)
+    {
+        --m_size;
+        ++m_version;
+    }
+}
+
+bool PeerTable::find(uint64_t peer_id, Peer &pr) const
+{
+    const Shard &shard = _shardOf(peer_id);
+    Lock lck(shard.access);
+    auto itpeer = shard.peers.find(peer_id);
+
+    if(itpeer == shard.peers.end())
+    {
+        return false;
+    }
+
+    pr = itpeer->second;
+    return true;
+}
+
+bool PeerTable::update(
+    uint64_t peer_id, 
+    const std::function<void(Peer&)> &fn)
+{
+    Shard &shard = _shardOf(peer_id);
+    Lock lck(shard.access);
+    auto itpeer = shard.peers.find(peer_id);
+
+    if(itpeer == shard.peers.end())
+    {
+        return false;
+    }
+
+    fn(itpeer->second);
+    return true;
+}
+
+void PeerTable::forEach(const std::function<void(Peer&)> &fn)
+{
+    for(auto &shard : m_shards)
+    {
+        Lock lck(shard.access);
+        for(auto &elem : shard.peers)
+        {
+            fn(elem.second);
+        }
+    }
+}
+
+PeerList PeerTable::snapshot() const
+{
+    PeerList result;
+    result.reserve(m_size);
+
+    for(auto &shard : m_shards)
+    {
+        Lock lck(shard.access);
+        result.insert(shard.peers.begin(), shard.peers.end());
+    }
+
+    return result;
+}
+
+std::shared_ptr<const PeerList> PeerTable::published()
+{
+    uint64_t version = m_version;
+    std::shared_ptr<const Published> current = std::atomic_load(&m_published);
+
+    if(!current || current->version != version)
+    {
+        //One reader copies, the others wait for it
+        //instead of copying the same Peers again.
+        Lock lck(m_publish_access);
+        version = m_version;
+        current = std::atomic_load(&m_published);
+
+        if(!current || current->version != version)
+        {
+            current = std::make_shared<const Published>(
+                Published{version, snapshot()});
+            std::atomic_store(&m_published, current);
+        }
+    }
+
+    return std::shared_ptr<const PeerList>(current, &current->peers);
+}
+
+bool PeerTable::empty() const
+{
+    return m_size == 0;
+}
+
+PeerTable::Shard& PeerTable::_shardOf(uint64_t peer_id)
+{
+    return m_shards[peer_id % SHARD_COUNT];
+}
+
+const PeerTable::Shard& PeerTable::_shardOf(uint64_t peer_id) const
+{
+    return m_shards[peer_id % SHARD_COUNT];
+}
+
+}
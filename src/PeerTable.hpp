@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef SPW_PEER_TABLE_HPP_
+#define SPW_PEER_TABLE_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "../include/Peer.hpp"
+
+namespace spw
+{
+
+/**
+ * The Peers of a TcpNode, split into shards by
+ * id. Each shard has its own lock, so work on
+ * one Peer does not wait for unrelated Peers.
+ * The functions passed to update() and forEach()
+ * run while a shard is locked. They must not
+ * use the table or call back into the user.
+*/
+class PeerTable
+{
+public:
+
+    static constexpr size_t SHARD_COUNT = 16;
+
+    PeerTable();
+
+    void insert(const Peer &pr);
+    void erase(uint64_t peer_id);
+
+    /**
+     * Copies the Peer with peer_id to pr.
+     * Returns false if there is none.
+    */
+    bool find(uint64_t peer_id, Peer &pr) const;
+
+    /**
+     * Calls fn with the stored Peer, e.g. to
+     * schedule its deletion. Returns false if
+     * there is no Peer with peer_id.
+    */
+    bool update(uint64_t peer_id, const std::function<void(Peer&)> &fn);
+
+    /**
+     * Calls fn for every Peer, locking one
+     * shard at a time.
+    */
+    void forEach(const std::function<void(Peer&)> &fn);
+
+    /**
+     * Copies all Peers. Peers that are inserted
+     * or erased meanwhile may be missed.
+    */
+    PeerList snapshot() const;
+
+    /**
+     * Returns an immutable copy of all Peers that
+     * is shared by every caller. It is only copied
+     * again after Peers were inserted or erased,
+     * so the state of the Peers in it may be old.
+    */
+    std::shared_ptr<const PeerList> published();
+
+    bool empty() const;
+
+private:
+
+    struct Shard
+    {
+        mutable std::mutex access;
+        PeerList peers;
+    };
+
+    Shard& _shardOf(uint64_t peer_id);
+    const Shard& _shardOf(uint64_t peer_id) const;
+
+    /**
+     * A published snapshot and the membership
+     * version it was taken at.
+    */
+    struct Published
+    {
+        uint64_t version;
+        PeerList peers;
+    };
+
+    Shard m_shards[SHARD_COUNT];
+    std::atomic<size_t> m_size;
+    std::atomic<uint64_t> m_version;
+    std::shared_ptr<const Published> m_published;
+    std::mutex m_publish_access;
+};
+
+}
+
+#endif // SPW_PEER_TABLE_HPP_
@@ -0,0 +1,292 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "Poller.hpp"
+
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#elif defined _WIN32
+
+#ifdef __MINGW32__
+#include <w32api.h>
+#else
+#define Windows7 0x601
+#endif
+
+#define _WIN32_WINNT Windows7
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#endif
+
+namespace spw
+{
+
+#ifdef __linux__
+
+static uint32_t toEpollEvents(uint32_t events)
+{
+    uint32_t epoll_events = 0;
+
+    if(events & Poller::READABLE)
+    {
+        epoll_events |= EPOLLIN;
+    }
+
+    if(events & Poller::WRITABLE)
+    {
+        epoll_events |= EPOLLOUT;
+    }
+
+    return epoll_events;
+}
+
+Poller::Poller() :
+    m_epoll_fd(epoll_create1(EPOLL_CLOEXEC)),
+    m_wakeup_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = m_wakeup_fd;
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wakeup_fd, &ev);
+}
+
+Poller::~Poller()
+{
+    ::close(m_wakeup_fd);
+    ::close(m_epoll_fd);
+}
+
+bool Poller::add(int32_t fd, uint32_t events)
+{
+    epoll_event ev;
+    ev.events = toEpollEvents(events);
+    ev.data.fd = fd;
+    return fd >= 0 && epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+bool Poller::modify(int32_t fd, uint32_t events)
+{
+    epoll_event ev;
+    ev.events = toEpollEvents(events);
+    ev.data.fd = fd;
+    return fd >= 0 && epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void Poller::remove(int32_t fd)
+{
+    if(fd >= 0)
+    {
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+}
+
+size_t Poller::wait(
+    std::vector<Event> &events, 
+    int timeout_ms, 
+    bool *woken)
+{
+    constexpr int max_events = 64;
+    epoll_event ready[max_events];
+
+    events.clear();
+
+    int count = epoll_wait(m_epoll_fd, ready, max_events, timeout_ms);
+
+    for(int i = 0; i < count; ++i)
+    {
+        if(ready[i].data.fd == m_wakeup_fd)
+        {
+            uint64_t wakeups;
+            while(read(m_wakeup_fd, &wakeups, sizeof(wakeups)) > 0);
+            if(woken)
+            {
+                *woken = true;
+            }
+            continue;
+        }
+
+        uint32_t flags = 0;
+
+        if(ready[i].events & EPOLLIN)
+        {
+            flags |= READABLE;
+        }
+
+        if(ready[i].events & EPOLLOUT)
+        {
+            flags |= WRITABLE;
+        }
+
+        if(ready[i].events & (EPOLLERR | EPOLLHUP))
+        {
+            flags |= FAILED;
+        }
+
+        events.push_back(Event{ready[i].data.fd, flags});
+    }
+
+    return events.size();
+}
+
+void Poller::wakeup()
+{
+    uint64_t one = 1;
+    ssize_t res = write(m_wakeup_fd, &one, sizeof(one));
+    (void)res;
+}
+
+int32_t Poller::fd() const
+{
+    return m_epoll_fd;
+}
+
+#elif _WIN32
+
+//WSAPoll() cannot be interrupted by another thread.
+//So Windows waits in slices of this length and
+//checks for a wakeup in between.
+constexpr int WAKEUP_CHECK_INTERVAL_MS = 10;
+
+Poller::Poller() : m_wakeup(false)
+{
+}
+
+Poller::~Poller()
+{
+}
+
+bool Poller::add(int32_t fd, uint32_t events)
+{
+    std::unique_lock<std::mutex> lck(m_fds_access);
+    return fd >= 0 && m_fds.insert({fd, events}).second;
+}
+
+bool Poller::modify(int32_t fd, uint32_t events)
+{
+    std::unique_lock<std::mutex> lck(m_fds_access);
+    auto itfd = m_fds.find(fd);
+    bool success = itfd != m_fds.end();
+
+    if(success)
+    {
+        itfd->second = events;
+    }
+
+    return success;
+}
+
+void Poller::remove(int32_t fd)
+{
+    std::unique_lock<std::mutex> lck(m_fds_access);
+    m_fds.erase(fd);
+}
+
+size_t Poller::wait(
+    std::vector<Event> &events, 
+    int timeout_ms, 
+    bool *woken)
+{
+    auto begin = std::chrono::steady_clock::now();
+    events.clear();
+
+    do
+    {
+        std::vector<WSAPOLLFD> pollfds;
+        std::unique_lock<std::mutex> lck(m_fds_access);
+        for(auto &elem : m_fds)
+        {
+            WSAPOLLFD pfd;
+            pfd.fd = static_cast<SOCKET>(elem.first);
+            pfd.events = 0;
+            pfd.revents = 0;
+            if(elem.second & READABLE) pfd.events |= POLLRDNORM;
+            if(elem.second & WRITABLE) pfd.events |= POLLWRNORM;
+            pollfds.push_back(pfd);
+        }
+        lck.unlock();
+
+        int slice = WAKEUP_CHECK_INTERVAL_MS;
+        if(timeout_ms >= 0 && timeout_ms < slice)
+        {
+            slice = timeout_ms;
+        }
+
+        if(pollfds.empty())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(slice));
+        }
+        else if(WSAPoll(pollfds.data(), 
+                        static_cast<ULONG>(pollfds.size()), slice) > 0)
+        {
+            for(auto &pfd : pollfds)
+            {
+                uint32_t flags = 0;
+                if(pfd.revents & POLLRDNORM) flags |= READABLE;
+                if(pfd.revents & POLLWRNORM) flags |= WRITABLE;
+                if(pfd.revents & (POLLERR | POLLHUP)) flags |= FAILED;
+
+                if(flags != 0)
+                {
+                    events.push_back(
+                        Event{static_cast<int32_t>(pfd.fd), flags});
+                }
+            }
+        }
+
+        if(m_wakeup.exchange(false))
+        {
+            if(woken)
+            {
+                *woken = true;
+            }
+            break;
+        }
+
+        if(!events.empty())
+        {
+            break;
+        }
+    }while(timeout_ms < 0 ||
+           std::chrono::steady_clock::now() - begin <
+           std::chrono::milliseconds(timeout_ms));
+
+    return events.size();
+}
+
+void Poller::wakeup()
+{
+    m_wakeup = true;
+}
+
+#endif
+
+}
@@ -0,0 +1,134 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef SPW_POLLER_HPP_
+#define SPW_POLLER_HPP_
+
+#include <cstdint>
+#include <vector>
+#include "../include/common.hpp"
+
+#ifdef _WIN32
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#endif
+
+namespace spw
+{
+
+/**
+ * Waits until one of several sockets becomes
+ * readable or writable. Uses epoll on Linux
+ * and WSAPoll on Windows.
+ * A wait() can be ended early from another
+ * thread by calling wakeup().
+*/
+class Poller
+{
+public:
+
+    enum EventFlags : uint32_t
+    {
+        READABLE = 0x1,
+        WRITABLE = 0x2,
+        FAILED = 0x4
+    };
+
+    struct Event
+    {
+        int32_t fd;
+        uint32_t events;
+    };
+
+    Poller();
+    Poller(const Poller &other) = delete;
+    virtual ~Poller();
+
+    /**
+     * Start watching a socket.
+     * @param[in] fd The socket
+     * @param[in] events READABLE and/or WRITABLE
+     * @return Could the socket be watched?
+    */
+    bool add(int32_t fd, uint32_t events);
+
+    /**
+     * Change the events of a watched socket.
+     * @param[in] fd The socket
+     * @param[in] events READABLE and/or WRITABLE
+     * @return Could the events be changed?
+    */
+    bool modify(int32_t fd, uint32_t events);
+
+    /**
+     * Stop watching a socket.
+     * @param[in] fd The socket
+    */
+    void remove(int32_t fd);
+
+    /**
+     * Wait until at least one watched socket
+     * is ready, wakeup() is called or the 
+     * timeout has passed.
+     * @param[out] events Ready sockets and their events
+     * @param[in] timeout_ms Timeout in milliseconds.
+     *            -1 waits without timeout.
+     * @param[out] woken Set if wakeup() ended the wait
+     * @return Number of ready sockets
+    */
+    size_t wait(
+        std::vector<Event> &events, 
+        int timeout_ms, 
+        bool *woken = nullptr);
+
+    /**
+     * End a running or the next wait().
+     * Can be called from any thread.
+    */
+    void wakeup();
+
+#ifdef __linux__
+    /**
+     * The epoll descriptor. It is readable while
+     * a wait() would return right away, so it can
+     * be watched by another Poller.
+    */
+    int32_t fd() const;
+#endif
+
+private:
+
+#ifdef __linux__
+    int m_epoll_fd = -1;
+    int m_wakeup_fd = -1;
+#elif _WIN32
+    std::mutex m_fds_access;
+    std::unordered_map<int32_t, uint32_t> m_fds;
+    std::atomic<bool> m_wakeup;
+#endif
+
+};
+
+}
+
+#endif //SPW_POLLER_HPP_
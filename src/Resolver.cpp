@@ -0,0 +1,339 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "Resolver.hpp"
+#include "ThreadSetup.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __linux__
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#elif defined _WIN32
+
+#ifdef __MINGW32__
+#include <w32api.h>
+#else
+#define Windows7 0x601
+#endif
+
+#define _WIN32_WINNT Windows7
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#endif
+
+namespace spw
+{
+
+using Lock = std::unique_lock<std::mutex>;
+
+Resolver::Resolver(size_t worker_count) :
+    m_worker_count(worker_count > 0 ? worker_count : 1),
+    m_running(false),
+    m_ttl(DEFAULT_TTL_MS),
+    m_negative_ttl(DEFAULT_NEGATIVE_TTL_MS),
+    m_max_entries(DEFAULT_CACHE_SIZE),
+    m_thread_options()
+{}
+
+Resolver::~Resolver()
+{
+    Lock lck(m_requests_access);
+    m_running = false;
+    m_requests.clear();
+    m_in_flight.clear();
+    lck.unlock();
+    m_request_available.notify_all();
+
+    //A worker inside getaddrinfo() is
+    //waited for until its lookup is over.
+    for(auto &worker : m_workers)
+    {
+        if(worker.joinable())
+        {
+            worker.join();
+        }
+    }
+}
+
+void Resolver::resolve(
+    const std::string &host,
+    uint16_t port,
+    Callback callback)
+{
+    std::string key = _cacheKey(host, port);
+    Lock lck(m_requests_access);
+    auto itcache = m_cache.find(key);
+
+    if(itcache != m_cache.end())
+    {
+        if(std::chrono::steady_clock::now() < itcache->second.expires)
+        {
+            m_lru.splice(m_lru.begin(), m_lru, itcache->second.lru_position);
+            std::vector<std::string> addresses = itcache->second.addresses;
+            std::string error = itcache->second.error;
+            lck.unlock();
+            callback(addresses, error);
+            return;
+        }
+
+        m_lru.erase(itcache->second.lru_position);
+        m_cache.erase(itcache);
+    }
+
+    //Join a lookup of the same host that is
+    //already running instead of starting another.
+    auto itflight = m_in_flight.find(key);
+    if(itflight != m_in_flight.end())
+    {
+        itflight->second.push_back(callback);
+        return;
+    }
+
+    m_in_flight[key].push_back(callback);
+
+    if(!m_running)
+    {
+        m_running = true;
+        for(size_t i = 0; i < m_worker_count; ++i)
+        {
+            m_workers.push_back(startThread(
+                "spw-resolve-" + std::to_string(i),
+                m_thread_options,
+                [this](){_workerJob();}));
+        }
+    }
+
+    m_requests.push_back(Request{host, port});
+    lck.unlock();
+    m_request_available.notify_one();
+}
+
+bool Resolver::isNumericAddress(const std::string &host)
+{
+    in_addr addr4;
+    in6_addr addr6;
+
+    return inet_pton(AF_INET, host.c_str(), &addr4) == 1 ||
+           inet_pton(AF_INET6, host.c_str(), &addr6) == 1;
+}
+
+void Resolver::setCache(
+    int ttl_ms,
+    int negative_ttl_ms,
+    size_t max_entries)
+{
+    Lock lck(m_requests_access);
+    m_ttl = std::chrono::milliseconds(std::max(ttl_ms, 0));
+    m_negative_ttl = std::chrono::milliseconds(std::max(negative_ttl_ms, 0));
+    m_max_entries = max_entries;
+
+    while(m_cache.size() > m_max_entries)
+    {
+        m_cache.erase(m_lru.back());
+        m_lru.pop_back();
+    }
+}
+
+void Resolver::invalidate(const std::string &host)
+{
+    Lock lck(m_requests_access);
+
+    if(host.empty())
+    {
+        m_cache.clear();
+        m_lru.clear();
+        return;
+    }
+
+    std::string prefix = host + ":";
+    auto itlru = m_lru.begin();
+
+    while(itlru != m_lru.end())
+    {
+        if(itlru->compare(0, prefix.size(), prefix) == 0)
+        {
+            m_cache.erase(*itlru);
+            itlru = m_lru.erase(itlru);
+        }
+        else
+        {
+            ++itlru;
+        }
+    }
+}
+
+bool Resolver::setThreadOptions(const ThreadOptions &options)
+{
+    Lock lck(m_requests_access);
+    m_thread_options = options;
+    bool started = m_running;
+    lck.unlock();
+
+    //Once they are started, workers are neither
+    //added nor removed before the destructor.
+    bool applied = true;
+    for(size_t i = 0; started && i < m_workers.size(); ++i)
+    {
+        applied = setupThread(m_workers[i],
+            "spw-resolve-" + std::to_string(i), options) && applied;
+    }
+
+    return applied;
+}
+
+std::string Resolver::_cacheKey(const std::string &host, uint16_t port)
+{
+    return host + ":" + std::to_string(port);
+}
+
+void Resolver::_storeResult(
+    const std::string &key,
+    const std::vector<std::string> &addresses,
+    const std::string &error,
+    bool host_unknown)
+{
+    //Only hosts that do not exist are cached
+    //as failures. Other errors may be temporary.
+    std::chrono::milliseconds ttl(0);
+    if(!addresses.empty())
+    {
+        ttl = m_ttl;
+    }
+    else if(host_unknown)
+    {
+        ttl = m_negative_ttl;
+    }
+
+    if(ttl.count() == 0 || m_max_entries == 0)
+    {
+        return;
+    }
+
+    auto itcache = m_cache.find(key);
+    if(itcache != m_cache.end())
+    {
+        m_lru.erase(itcache->second.lru_position);
+        m_cache.erase(itcache);
+    }
+
+    m_lru.push_front(key);
+    m_cache[key] = CacheEntry{
+        addresses, error,
+        std::chrono::steady_clock::now() + ttl,
+        m_lru.begin()};
+
+    while(m_cache.size() > m_max_entries)
+    {
+        m_cache.erase(m_lru.back());
+        m_lru.pop_back();
+    }
+}
+
+void Resolver::_workerJob()
+{
+    while(true)
+    {
+        Lock lck(m_requests_access);
+        m_request_available.wait(lck, [this](){
+            return !m_requests.empty() || !m_running;});
+
+        if(!m_running)
+        {
+            break;
+        }
+
+        Request req = std::move(m_requests.front());
+        m_requests.pop_front();
+        lck.unlock();
+
+        addrinfo hints;
+        addrinfo *result = nullptr;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        std::string port_str = std::to_string(req.port);
+        std::vector<std::string> addresses;
+        std::string error;
+
+        int gai_result = getaddrinfo(
+            req.host.c_str(), port_str.c_str(), &hints, &result);
+
+        if(gai_result == 0)
+        {
+            for(addrinfo *ai = result; ai != nullptr; ai = ai->ai_next)
+            {
+                char numeric_host[NI_MAXHOST];
+
+                if(getnameinfo(ai->ai_addr, ai->ai_addrlen,
+                               numeric_host, sizeof(numeric_host),
+                               nullptr, 0, NI_NUMERICHOST) == 0)
+                {
+                    addresses.push_back(numeric_host);
+                }
+            }
+
+            freeaddrinfo(result);
+        }
+        else
+        {
+            error = gai_strerror(gai_result);
+        }
+
+        if(addresses.empty() && error.empty())
+        {
+            error = "No usable address";
+        }
+
+#ifdef EAI_NODATA
+        bool host_unknown = gai_result == EAI_NONAME ||
+                            gai_result == EAI_NODATA;
+#else
+        bool host_unknown = gai_result == EAI_NONAME;
+#endif
+
+        std::string key = _cacheKey(req.host, req.port);
+        lck.lock();
+        _storeResult(key, addresses, error, host_unknown);
+        std::vector<Callback> callbacks;
+        auto itflight = m_in_flight.find(key);
+        if(itflight != m_in_flight.end())
+        {
+            callbacks.swap(itflight->second);
+            m_in_flight.erase(itflight);
+        }
+        lck.unlock();
+
+        for(auto &callback : callbacks)
+        {
+            callback(addresses, error);
+        }
+    }
+}
+
+}
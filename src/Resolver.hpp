@@ -0,0 +1,181 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef SPW_RESOLVER_HPP_
+#define SPW_RESOLVER_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <unordered_map>
+#include "../include/common.hpp"
+
+namespace spw
+{
+
+/**
+ * Resolves host names in a pool of worker
+ * threads, so a slow lookup only occupies
+ * one worker instead of the caller.
+ * The workers are started with the
+ * first call to resolve().
+ * Results are cached per host and port.
+ * Successful lookups are kept for ttl,
+ * hosts that do not exist for negative_ttl.
+ * When the cache is full the entry that
+ * was used least recently is dropped.
+ * Lookups of a host that is already being
+ * resolved wait for that lookup.
+*/
+class Resolver
+{
+public:
+
+    /**
+     * Receives the numeric addresses of a host
+     * in the order getaddrinfo() returned them.
+     * An empty list means the host could not be
+     * resolved, error then describes why.
+    */
+    using Callback = std::function<void(
+        std::vector<std::string> addresses,
+        std::string error)>;
+
+    explicit Resolver(size_t worker_count = 4);
+    Resolver(const Resolver &other) = delete;
+    virtual ~Resolver();
+
+    /**
+     * Queue a lookup. callback is called
+     * from a worker thread once it is done,
+     * or right away for a cached result.
+     * Lookups that are still queued when the
+     * Resolver is destroyed are dropped without
+     * calling their callback.
+     * @param[in] host Host name to resolve
+     * @param[in] port Port that is connected to
+     * @param[in] callback Receives the result
+    */
+    void resolve(
+        const std::string &host,
+        uint16_t port,
+        Callback callback);
+
+    /**
+     * Check whether host already is an IPv4
+     * or IPv6 address and needs no lookup.
+     * @param[in] host Host name or address
+     * @return Is host a literal address?
+    */
+    static bool isNumericAddress(const std::string &host);
+
+    /**
+     * Configure the cache. A ttl of 0 disables
+     * caching of successful lookups, a negative_ttl
+     * of 0 disables caching of failed ones.
+     * @param[in] ttl_ms Lifetime of resolved addresses
+     * @param[in] negative_ttl_ms Lifetime of unknown hosts
+     * @param[in] max_entries Size bound of the cache
+    */
+    void setCache(int ttl_ms, int negative_ttl_ms, size_t max_entries);
+
+    /**
+     * Forget cached results of a host
+     * for all ports. An empty host
+     * clears the whole cache.
+     * @param[in] host Host name to forget
+    */
+    void invalidate(const std::string &host = "");
+
+    /**
+     * Applies options to the workers now and
+     * when they are started. Workers are
+     * named spw-resolve-<n>.
+     * @return Could the options be applied
+     *         to the running workers?
+    */
+    bool setThreadOptions(const ThreadOptions &options);
+
+private:
+
+    const int DEFAULT_TTL_MS = 30000;
+    const int DEFAULT_NEGATIVE_TTL_MS = 5000;
+    const size_t DEFAULT_CACHE_SIZE = 1024;
+
+    struct Request
+    {
+        std::string host;
+        uint16_t port;
+    };
+
+    struct CacheEntry
+    {
+        std::vector<std::string> addresses;
+        std::string error;
+        std::chrono::steady_clock::time_point expires;
+        std::list<std::string>::iterator lru_position;
+    };
+
+    static std::string _cacheKey(const std::string &host, uint16_t port);
+
+    void _workerJob();
+
+    /**
+     * Stores the result of a lookup if it may
+     * be cached and evicts the least recently
+     * used entries beyond the size bound.
+     * requests_access must be locked.
+    */
+    void _storeResult(
+        const std::string &key,
+        const std::vector<std::string> &addresses,
+        const std::string &error,
+        bool host_unknown);
+
+    size_t m_worker_count;
+    std::atomic<bool> m_running;
+    std::vector<std::thread> m_workers;
+    std::deque<Request> m_requests;
+    std::unordered_map<std::string, std::vector<Callback>> m_in_flight;
+    std::unordered_map<std::string, CacheEntry> m_cache;
+    std::list<std::string> m_lru;
+    std::chrono::milliseconds m_ttl;
+    std::chrono::milliseconds m_negative_ttl;
+    size_t m_max_entries;
+    std::mutex m_requests_access;
+    std::condition_variable m_request_available;
+    ThreadOptions m_thread_options;
+
+};
+
+}
+
+#endif //SPW_RESOLVER_HPP_
@@ -22,17 +22,22 @@ SOFTWARE.
 
 #include "Socket.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <thread>
 
 #ifdef __linux__
 
 #include <errno.h>
+#include <signal.h>
 #include <unistd.h>
+#include <sys/sendfile.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <fcntl.h>
 
 #elif defined _WIN32
@@ -46,6 +51,7 @@ SOFTWARE.
 #define _WIN32_WINNT Windows7
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#include <io.h>
 
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -97,6 +103,71 @@ static bool setNonBlocking(int sockfd)
     return success;
 }
 
+static bool wouldBlock(int errornum)
+{
+#ifdef __linux__
+    return errornum == EAGAIN || errornum == EWOULDBLOCK;
+#elif _WIN32
+    return errornum == WSAEWOULDBLOCK || errornum == WSAEINPROGRESS ||
+           errornum == WSATRY_AGAIN;
+#endif
+}
+
+//Lets a listener accept data with the SYN.
+//Not having Fast Open is no reason to fail.
+static void enableFastOpen(int sockfd, int queueLength)
+{
+#ifdef __linux__
+#ifdef TCP_FASTOPEN
+    setsockopt(sockfd, IPPROTO_TCP, TCP_FASTOPEN,
+               &queueLength, sizeof(queueLength));
+#endif
+#elif _WIN32
+#ifdef TCP_FASTOPEN
+    DWORD enable = 1;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_FASTOPEN,
+               (const char*)&enable, sizeof(enable));
+#endif
+    (void)queueLength;
+#endif
+}
+
+#ifdef __linux__
+//Unlike send(), sendfile() has no MSG_NOSIGNAL flag. So SIGPIPE
+//is blocked for the calling thread while sending and a SIGPIPE
+//that was raised by this call is discarded before unblocking.
+static ssize_t sendFileNoSignal(
+    int sockfd,
+    int filefd,
+    off_t *offset,
+    size_t count)
+{
+    sigset_t sigpipe_set;
+    sigset_t pending_set;
+    sigset_t old_set;
+    sigemptyset(&sigpipe_set);
+    sigaddset(&sigpipe_set, SIGPIPE);
+
+    sigpending(&pending_set);
+    bool sigpipe_was_pending = sigismember(&pending_set, SIGPIPE) == 1;
+    pthread_sigmask(SIG_BLOCK, &sigpipe_set, &old_set);
+
+    ssize_t bytes_sent = ::sendfile(sockfd, filefd, offset, count);
+    int sendfile_errno = errno;
+
+    if(bytes_sent == -1 && sendfile_errno == EPIPE && !sigpipe_was_pending)
+    {
+        timespec no_wait = {0, 0};
+        sigtimedwait(&sigpipe_set, NULL, &no_wait);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+    errno = sendfile_errno;
+
+    return bytes_sent;
+}
+#endif
+
 
 Socket::Socket()
 {
@@ -173,6 +244,11 @@ bool Socket::listen(
                     result->ai_socktype,
                     result->ai_protocol);
 
+            if(m_fast_open_queue > 0)
+            {
+                enableFastOpen(m_socket_fd, m_fast_open_queue);
+            }
+
 #ifdef __linux__
             
             if(m_socket_fd != -1)
@@ -267,8 +343,53 @@ bool Socket::listen(
 bool Socket::connect(
     const std::string &ip, 
     uint16_t port)
+{
+    bool success = startConnect(ip, port);
+
+    if(success && !m_is_connected)
+    {
+        std::this_thread::sleep_for(
+                std::chrono::milliseconds(sleepTime()));
+        success = finishConnect();
+    }
+
+    if(!success)
+    {
+        int errornum = m_last_errno;
+        this->close();
+        m_last_errno = errornum;
+    }
+
+    return success;
+}
+
+bool Socket::startConnect(
+    const std::string &ip,
+    uint16_t port)
+{
+    size_t bytes_sent = 0;
+    return connectNonBlocking(ip, port, nullptr, bytes_sent);
+}
+
+bool Socket::startFastOpenConnect(
+    const std::string &ip,
+    uint16_t port,
+    const std::vector<uint8_t> &data,
+    size_t &bytesSent)
+{
+    return connectNonBlocking(ip, port, &data, bytesSent);
+}
+
+bool Socket::connectNonBlocking(
+    const std::string &ip,
+    uint16_t port,
+    const std::vector<uint8_t> *fastOpenData,
+    size_t &bytesSent)
 {
     bool success = false;
+    bool in_progress = false;
+    bool fast_open = false;
+    bytesSent = 0;
     this->close();
 
     addrinfo hints;
@@ -291,69 +412,110 @@ bool Socket::connect(
             
             if(setNonBlocking(m_socket_fd))
             {
-                int conn = ::connect(m_socket_fd, result->ai_addr, result->ai_addrlen);
-                if(conn == 0)
+#ifdef MSG_FASTOPEN
+                //The data goes out with the SYN if a cookie
+                //of the remote is cached. Otherwise only the
+                //SYN asks for a cookie and nothing is sent.
+                if(fastOpenData && !fastOpenData->empty())
                 {
-                    success = true;
+                    ssize_t sent = sendto(
+                            m_socket_fd, fastOpenData->data(),
+                            fastOpenData->size(),
+                            MSG_FASTOPEN | MSG_NOSIGNAL,
+                            result->ai_addr, result->ai_addrlen);
+
+                    if(sent >= 0 || errno == EINPROGRESS)
+                    {
+                        fast_open = true;
+                        in_progress = true;
+                        bytesSent = sent > 0 ? static_cast<size_t>(sent) : 0;
+                    }
                 }
-#ifdef __linux__
-                else if(errno == EINPROGRESS)
+#endif
+
+                //Plain connect if Fast Open is
+                //not wanted or not supported.
+                if(!fast_open)
                 {
-                    std::this_thread::sleep_for(
-                            std::chrono::milliseconds(sleepTime()));
-                        
-                    int sock_error;
-                    socklen_t len = sizeof(sock_error);
-
-                    if(getsockopt(m_socket_fd,SOL_SOCKET,SO_ERROR,
-                                                (void*)&sock_error, &len) == 0)
+                    int conn = ::connect(m_socket_fd, result->ai_addr, result->ai_addrlen);
+                    if(conn == 0)
                     {
-                        if(sock_error == 0)
-                        { 
-                            success = true;
-                        }
+                        success = true;
                     }
-                }
+#ifdef __linux__
+                    else if(errno == EINPROGRESS)
 #elif _WIN32
-                else if(WSAGetLastError() == WSAEWOULDBLOCK)
-                {
-                    std::this_thread::sleep_for(
-                            std::chrono::milliseconds(sleepTime()));
-
-                    conn = ::connect(m_socket_fd, result->ai_addr, result->ai_addrlen);
-                    int last_error = WSAGetLastError();
-                    int optval;
-                    int len = sizeof(optval);
-
-                    if((conn == 0 || last_error == WSAEISCONN) &&
-                         getsockopt(m_socket_fd, SOL_SOCKET, SO_ERROR,
-                                                (char*)&optval, &len) == 0)
+                    else if(WSAGetLastError() == WSAEWOULDBLOCK)
+#endif
                     {
-                        if(optval == 0)
-                        {
-                            success = true;
-                        }
+                        in_progress = true;
                     }
                 }
-#endif
             }
 
             freeaddrinfo(result);
         }
     }
 
-    if(!success)
+    if(success)
     {
+        m_is_connected = true;
+        clearErrno();
+    }
+    else if(in_progress)
+    {
+        clearErrno();
+    }
+    else
+    {
+        setErrno();
         this->close();
+    }
+
+    return success || in_progress;
+}
+
+bool Socket::finishConnect()
+{
+    if(m_is_connected)
+    {
+        return true;
+    }
+
+    if(m_socket_fd == -1)
+    {
+        return false;
+    }
+
+    //A failed attempt leaves its error in SO_ERROR.
+    //Otherwise only a connected socket has a peer.
+    int sock_error = 0;
+    socklen_t len = sizeof(sock_error);
+    sockaddr_storage peer_addr;
+    socklen_t addr_size = sizeof(peer_addr);
+
+    if(getsockopt(m_socket_fd, SOL_SOCKET, SO_ERROR,
+                  (char*)&sock_error, &len) != 0)
+    {
         setErrno();
     }
-    else
+    else if(sock_error != 0)
+    {
+        m_last_errno = sock_error;
+    }
+    else if(getpeername(m_socket_fd, 
+                        (sockaddr*)&peer_addr, &addr_size) == 0)
     {
         m_is_connected = true;
         clearErrno();
     }
+    else
+    {
+        //Still connecting.
+        clearErrno();
+    }
 
-    return success;
+    return m_is_connected;
 }
 
 void Socket::close()
@@ -389,7 +551,7 @@ ISocket* Socket::accept()
         else
         {
             setErrno();
-            int errornum = getLastErrno();
+            int errornum = m_last_errno;
 #ifdef __linux__
             if(errornum == EAGAIN || errornum == EWOULDBLOCK)
             {
@@ -490,6 +652,11 @@ receive_end:
 }
 
 size_t Socket::send(const std::vector<uint8_t> &dataToSend)
+{
+    return sendBytes(dataToSend.data(), dataToSend.size());
+}
+
+size_t Socket::sendBytes(const uint8_t *data, size_t length)
 {
     size_t result = 0;
 
@@ -497,12 +664,10 @@ size_t Socket::send(const std::vector<uint8_t> &dataToSend)
     {
 #ifdef __linux__
         ssize_t bytes_sent = 
-        ::send(m_socket_fd, dataToSend.data(), 
-                     dataToSend.size(),MSG_NOSIGNAL);
+        ::send(m_socket_fd, data, length, MSG_NOSIGNAL);
 #elif _WIN32
         int bytes_sent = 
-        ::send(m_socket_fd, (const char*)dataToSend.data(),
-                     dataToSend.size(), 0);
+        ::send(m_socket_fd, (const char*)data, length, 0);
 #endif
 
         if(bytes_sent >= 0)
@@ -513,12 +678,146 @@ size_t Socket::send(const std::vector<uint8_t> &dataToSend)
         else
         {
             setErrno();
+            //A full send buffer is not an error.
+            //Nothing was sent, try again later.
+            if(wouldBlock(m_last_errno))
+            {
+                clearErrno();
+            }
         }
     }
 
     return result;
 }
 
+size_t Socket::sendFile(
+    int fileDescriptor,
+    uint64_t offset,
+    size_t length)
+{
+    size_t result = 0;
+
+    if(isConnected() && !isListener() && fileDescriptor != -1)
+    {
+#ifdef __linux__
+        off_t file_offset = static_cast<off_t>(offset);
+        ssize_t bytes_sent = sendFileNoSignal(
+                m_socket_fd, fileDescriptor, &file_offset, length);
+
+        if(bytes_sent >= 0)
+        {
+            result = static_cast<size_t>(bytes_sent);
+            clearErrno();
+        }
+        else
+        {
+            setErrno();
+            if(wouldBlock(m_last_errno))
+            {
+                clearErrno();
+            }
+        }
+#elif _WIN32
+        //There is no sendfile() on Windows.
+        //Read one chunk of the file and send it.
+        std::vector<uint8_t> chunk(
+                std::min(length, SPW_DEF_FILE_CHUNK_SIZE));
+        int bytes_read = -1;
+
+        if(_lseeki64(fileDescriptor, offset, SEEK_SET) != -1)
+        {
+            bytes_read = _read(fileDescriptor, chunk.data(),
+                               static_cast<unsigned>(chunk.size()));
+        }
+
+        if(bytes_read > 0)
+        {
+            chunk.resize(bytes_read);
+            result = send(chunk);
+        }
+        else
+        {
+            m_last_errno = errno;
+        }
+#endif
+    }
+
+    return result;
+}
+
+void Socket::setFastOpenQueue(int queueLength)
+{
+    m_fast_open_queue = queueLength;
+}
+
+bool Socket::setCorked(bool corked)
+{
+    bool success = false;
+
+    if(isConnected() && !isListener())
+    {
+#ifdef __linux__
+        int value = corked ? 1 : 0;
+
+        if(setsockopt(
+                    m_socket_fd,
+                    IPPROTO_TCP,
+                    TCP_CORK,
+                    &value, sizeof(value)) == 0)
+        {
+            success = true;
+        }
+        else
+        {
+            setErrno();
+        }
+#elif _WIN32
+        (void)corked;
+#endif
+    }
+
+    return success;
+}
+
+bool Socket::setBusyPoll(uint32_t usec)
+{
+    bool success = false;
+
+#ifdef __linux__
+#ifdef SO_BUSY_POLL
+    int value = static_cast<int>(usec);
+
+    if(setsockopt(
+                m_socket_fd,
+                SOL_SOCKET,
+                SO_BUSY_POLL,
+                &value, sizeof(value)) == 0)
+    {
+        success = true;
+    }
+    else
+    {
+        setErrno();
+    }
+
+//Kernels before 5.11 do not know it,
+//SO_BUSY_POLL works without it.
+#ifdef SO_PREFER_BUSY_POLL
+    int prefer = usec > 0 ? 1 : 0;
+    setsockopt(
+        m_socket_fd,
+        SOL_SOCKET,
+        SO_PREFER_BUSY_POLL,
+        &prefer, sizeof(prefer));
+#endif
+#endif
+#elif _WIN32
+    (void)usec;
+#endif
+
+    return success;
+}
+
 int32_t Socket::socketNumber()
 {
     return m_socket_fd;
@@ -721,14 +1020,18 @@ std::string Socket::peerName()
 }
 
 std::string Socket::getLastErrnoString()
+{
+    return errnoString(getLastErrno());
+}
+
+std::string Socket::errnoString(int errornum)
 {
     std::string errstr;
-    int lasterrno = getLastErrno();
 
-    if(lasterrno != 0)
+    if(errornum != 0)
     {
 #ifdef __linux__
-        errstr = std::string(strerror(lasterrno));
+        errstr = std::string(strerror(errornum));
 #elif _WIN32
         static char msgbuf[256];
         char *begin = msgbuf;
@@ -739,7 +1042,7 @@ std::string Socket::getLastErrnoString()
             FORMAT_MESSAGE_FROM_SYSTEM | 
             FORMAT_MESSAGE_IGNORE_INSERTS,
             NULL,
-            lasterrno,
+            errornum,
             MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
             msgbuf,
             sizeof(msgbuf),
@@ -35,6 +35,7 @@ namespace spw
 
 constexpr uint32_t SPW_DEF_SLEEPTIME_MS = 10;
 constexpr size_t SPW_DEF_RECBUF_SIZE = 1024;
+constexpr size_t SPW_DEF_FILE_CHUNK_SIZE = 65536;
 
 
 class Socket : public ISocket
@@ -52,6 +53,18 @@ public:
         const std::string &ip, 
         uint16_t port) override;
 
+    bool startConnect(
+        const std::string &ip,
+        uint16_t port) override;
+
+    bool startFastOpenConnect(
+        const std::string &ip,
+        uint16_t port,
+        const std::vector<uint8_t> &data,
+        size_t &bytesSent) override;
+
+    bool finishConnect() override;
+
     void close() override;
 
     ISocket* accept() override;
@@ -62,6 +75,20 @@ public:
     size_t send(
         const std::vector<uint8_t> &dataToSend) override;
 
+    size_t sendBytes(const uint8_t *data, size_t length) override;
+
+    size_t sendFile(
+        int fileDescriptor,
+        uint64_t offset,
+        size_t length) override;
+
+    //TCP_CORK on Linux, not available on Windows.
+    bool setCorked(bool corked) override;
+
+    void setFastOpenQueue(int queueLength) override;
+
+    bool setBusyPoll(uint32_t usec) override;
+
     int32_t socketNumber() override;
     bool isListener() override;
     uint16_t listenPort() override;
@@ -78,6 +105,9 @@ public:
     int getLastErrno() override;
     std::string getLastErrnoString() override;
 
+    //Text for an error number of getLastErrno().
+    static std::string errnoString(int errornum);
+
 protected:
 
     virtual void setErrno();
@@ -92,6 +122,12 @@ private:
     static WSAData m_wsadata;
 #endif
 
+    bool connectNonBlocking(
+        const std::string &ip,
+        uint16_t port,
+        const std::vector<uint8_t> *fastOpenData,
+        size_t &bytesSent);
+
     int m_socket_fd = -1;
     bool m_is_listener = false;
     bool m_is_connected = false;
@@ -100,6 +136,7 @@ private:
     size_t m_receive_buffer_size = SPW_DEF_RECBUF_SIZE;
     uint32_t m_sleep_time = SPW_DEF_SLEEPTIME_MS;
     int m_last_errno = 0;
+    int m_fast_open_queue = 0;
 
 };
 
@@ -47,7 +47,8 @@ namespace spw
 {
 
 
-TcpNode::TcpNode(IpVersion ipv) : m_private(new TcpNodePrivate(ipv))
+TcpNode::TcpNode(IpVersion ipv, RunMode mode) : 
+    m_private(new TcpNodePrivate(ipv, mode))
 {
 }
 
@@ -82,9 +83,125 @@ void TcpNode::connectTo(
     return m_private->connectTo(ipaddr, port);
 }
 
-void TcpNode::sendData(const Peer &pr, const std::vector<uint8_t> &dat)
+void TcpNode::connectTo(
+    const std::string &ipaddr,
+    uint16_t port,
+    const ReconnectPolicy &policy)
+{
+    return m_private->connectTo(ipaddr, port, policy);
+}
+
+void TcpNode::connectTo(
+    const std::string &ipaddr,
+    uint16_t port,
+    const std::vector<uint8_t> &first_data)
+{
+    return m_private->connectTo(ipaddr, port, first_data);
+}
+
+void TcpNode::connectToAll(
+    const std::vector<Endpoint> &endpoints,
+    std::function<void(std::vector<ConnectResult> results)> completion)
+{
+    return m_private->connectToAll(endpoints, completion);
+}
+
+Peer TcpNode::pooledPeer(
+    const std::string &host,
+    uint16_t port)
+{
+    return m_private->pooledPeer(host, port);
+}
+
+void TcpNode::setPoolLimits(
+    size_t min_per_endpoint,
+    size_t max_per_endpoint,
+    int idle_timeout_ms)
+{
+    m_private->setPoolLimits(
+        min_per_endpoint, max_per_endpoint, idle_timeout_ms);
+}
+
+bool TcpNode::sendData(
+    const Peer &pr,
+    const std::vector<uint8_t> &dat,
+    Priority priority)
+{
+    return m_private->sendData(pr, dat, priority);
+}
+
+bool TcpNode::sendFile(
+    const Peer &pr,
+    const std::string &path,
+    uint64_t offset,
+    uint64_t length,
+    Priority priority)
+{
+    return m_private->sendFile(pr, path, offset, length, priority);
+}
+
+bool TcpNode::sendFile(
+    const Peer &pr,
+    int fd,
+    uint64_t offset,
+    uint64_t length,
+    Priority priority)
+{
+    return m_private->sendFile(pr, fd, offset, length, priority);
+}
+
+bool TcpNode::sendData(
+    const Peer &pr,
+    const std::vector<uint8_t> &dat,
+    SendCompletion completion,
+    Priority priority)
+{
+    return m_private->sendData(pr, dat, completion, priority);
+}
+
+bool TcpNode::sendFile(
+    const Peer &pr,
+    const std::string &path,
+    SendCompletion completion,
+    uint64_t offset,
+    uint64_t length,
+    Priority priority)
+{
+    return m_private->sendFile(pr, path, completion, offset, length, priority);
+}
+
+bool TcpNode::sendFile(
+    const Peer &pr,
+    int fd,
+    SendCompletion completion,
+    uint64_t offset,
+    uint64_t length,
+    Priority priority)
+{
+    return m_private->sendFile(pr, fd, completion, offset, length, priority);
+}
+
+void TcpNode::setSendWatermarks(size_t low, size_t high)
+{
+    return m_private->setSendWatermarks(low, high);
+}
+
+size_t TcpNode::queuedBytes(const Peer &pr)
+{
+    return m_private->queuedBytes(pr);
+}
+
+void TcpNode::setCoalescing(
+    const Peer &pr,
+    uint32_t window_us,
+    size_t max_bytes)
+{
+    m_private->setCoalescing(pr, window_us, max_bytes);
+}
+
+void TcpNode::flush(const Peer &pr)
 {
-    return m_private->sendData(pr, dat);
+    m_private->flush(pr);
 }
 
 uint16_t TcpNode::listenPort()
@@ -112,6 +229,71 @@ void TcpNode::setConnectTimeout(int ms)
     return m_private->setConnectTimeout(ms);
 }
 
+int TcpNode::resolveTimeout()
+{
+    return m_private->resolveTimeout();
+}
+
+void TcpNode::setResolveTimeout(int ms)
+{
+    return m_private->setResolveTimeout(ms);
+}
+
+void TcpNode::setFastOpen(int queue_length)
+{
+    return m_private->setFastOpen(queue_length);
+}
+
+void TcpNode::setResolveCache(
+    int ttl_ms,
+    int negative_ttl_ms,
+    size_t max_entries)
+{
+    m_private->setResolveCache(ttl_ms, negative_ttl_ms, max_entries);
+}
+
+void TcpNode::invalidateResolveCache(const std::string &host)
+{
+    m_private->invalidateResolveCache(host);
+}
+
+void TcpNode::setCallbackWorkers(size_t worker_count)
+{
+    return m_private->setCallbackWorkers(worker_count);
+}
+
+bool TcpNode::setThreadOptions(
+    NodeThread thread, 
+    const ThreadOptions &options)
+{
+    return m_private->setThreadOptions(thread, options);
+}
+
+void TcpNode::poll(int timeout_ms)
+{
+    return m_private->poll(timeout_ms);
+}
+
+int TcpNode::pollDescriptor()
+{
+    return m_private->pollDescriptor();
+}
+
+int TcpNode::pollTimeout()
+{
+    return m_private->pollTimeout();
+}
+
+void TcpNode::processEvents()
+{
+    return m_private->processEvents();
+}
+
+void TcpNode::setBusyPoll(uint32_t spin_us)
+{
+    return m_private->setBusyPoll(spin_us);
+}
+
 void TcpNode::setSleepTime(int ms)
 {
     return m_private->setSleepTime(ms);
@@ -137,74 +319,91 @@ PeerList TcpNode::allPeers()
     return m_private->allPeers();
 }
 
+std::shared_ptr<const PeerList> TcpNode::peerSnapshot()
+{
+    return m_private->peerSnapshot();
+}
+
 void TcpNode::onStartedListening(
-    std::function<void(uint16_t)> callback)
+    ListenCallback callback)
 {
     return m_private->onStartedListening(callback);
 }
 
 void TcpNode::onStoppedListening(
-    std::function<void()> callback)
+    StoppedCallback callback)
 {
     return m_private->onStoppedListening(callback);
 }
 
 void TcpNode::onAccept(
-    std::function<void(Peer pr)> callback)
+    PeerCallback callback)
 {
     return m_private->onAccept(callback);
 }
 
 void TcpNode::onReceive(
-    std::function<void(Peer pr, std::vector<uint8_t> bytes)> callback)
+    ReceiveCallback callback)
 {
     return m_private->onReceive(callback);
 }
 
 void TcpNode::onDisconnect(
-    std::function<void(Peer pr)> callback)
+    PeerCallback callback)
 {
     return m_private->onDisconnect(callback);
 }
 
 void TcpNode::onClosedConnection(
-    std::function<void(Peer pr)> callback)
+    PeerCallback callback)
 {
     return m_private->onClosedConnection(callback);
 }
 
 void TcpNode::onConnect(
-    std::function<void(Peer pr)> callback)
+    PeerCallback callback)
 {
     return m_private->onConnect(callback);
 }
 
 void TcpNode::onSend(
-    std::function<void(Peer pr, size_t amount)> callback)
+    SentCallback callback)
 {
     return m_private->onSend(callback);
 }
 
+void TcpNode::onWritable(
+    PeerCallback callback)
+{
+    return m_private->onWritable(callback);
+}
+
+void TcpNode::onReconnect(
+    PeerCallback callback)
+{
+    return m_private->onReconnect(callback);
+}
+
 void TcpNode::onListenError(
-    std::function<void (Message msg)> callback)
+    ErrorCallback callback)
 {
     return m_private->onListenError(callback);
 }
 
 void TcpNode::onSendError(
-    std::function<void (Message msg)> callback)
+    ErrorCallback callback)
 {
     return m_private->onSendError(callback);
 }
 
 void TcpNode::onConnectError(
-    std::function<void (Message msg)> callback)
+    ErrorCallback callback)
 {
     return m_private->onConnectError(callback);
 }
 
 void TcpNode::onFaultyConnectionClosed(
-    std::function<void (Peer pr, Message err)> callback)
+    PeerErrorCallback callback)
 {
     return m_private->onFaultyConnectionClosed(callback);
 }
@@ -26,16 +26,22 @@ SOFTWARE.
 
 #ifdef __linux__
 #include <unistd.h>
+#elif _WIN32
+#include <io.h>
 #endif
 
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <utility>
 #include <ctime>
 #include <functional>
 #include <chrono>
 #include <algorithm>
+#include <random>
+#include <cmath>
 
 #include "TcpNodePrivate.hpp"
+#include "ThreadSetup.hpp"
 #include "Socket.hpp"
 #include "../include/Peer.hpp"
 #include "PeerPrivate.hpp"
@@ -44,8 +50,108 @@ namespace spw
 {
 
 std::atomic<uint64_t> TcpNodePrivate::m_connection_counter(0);
+constexpr size_t TcpNodePrivate::OutBufferQueue::CLASS_COUNT;
+constexpr size_t TcpNodePrivate::OutBufferQueue::NO_CLASS;
 
-TcpNodePrivate::TcpNodePrivate(IpVersion ipv)  :
+static int openFileForReading(const std::string &path)
+{
+#ifdef __linux__
+    return ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#elif _WIN32
+    return _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#endif
+}
+
+static int duplicateFile(int fd)
+{
+#ifdef __linux__
+    return fcntl(fd, F_DUPFD_CLOEXEC, 0);
+#elif _WIN32
+    return _dup(fd);
+#endif
+}
+
+static void closeFile(int fd)
+{
+#ifdef __linux__
+    ::close(fd);
+#elif _WIN32
+    _close(fd);
+#endif
+}
+
+static bool fileSize(int fd, uint64_t &size)
+{
+#ifdef __linux__
+    struct stat file_stat;
+    bool success = fstat(fd, &file_stat) == 0;
+#elif _WIN32
+    struct _stati64 file_stat;
+    bool success = _fstati64(fd, &file_stat) == 0;
+#endif
+
+    if(success)
+    {
+        size = static_cast<uint64_t>(file_stat.st_size);
+    }
+
+    return success;
+}
+
+//Poller timeouts where -1 means forever.
+static int earlierTimeout(int timeout_ms, int other_ms)
+{
+    if(timeout_ms == -1 || (other_ms != -1 && other_ms < timeout_ms))
+    {
+        return other_ms;
+    }
+
+    return timeout_ms;
+}
+
+TcpNodePrivate::OutBuffer::OutBuffer(OutBuffer &&other) :
+    data(std::move(other.data)),
+    data_offset(other.data_offset),
+    file_fd(other.file_fd),
+    file_offset(other.file_offset),
+    file_remaining(other.file_remaining),
+    completion(std::move(other.completion))
+{
+    other.file_fd = -1;
+}
+
+TcpNodePrivate::OutBuffer::~OutBuffer()
+{
+    if(file_fd != -1)
+    {
+        closeFile(file_fd);
+    }
+}
+
+TcpNodePrivate::OutBuffer& TcpNodePrivate::OutBuffer::operator=(
+    OutBuffer &&other)
+{
+    if(this != &other)
+    {
+        if(file_fd != -1)
+        {
+            closeFile(file_fd);
+        }
+
+        data = std::move(other.data);
+        data_offset = other.data_offset;
+        file_fd = other.file_fd;
+        file_offset = other.file_offset;
+        file_remaining = other.file_remaining;
+        completion = std::move(other.completion);
+        other.file_fd = -1;
+    }
+
+    return *this;
+}
+
+TcpNodePrivate::TcpNodePrivate(IpVersion ipv, RunMode mode)  :
+    m_run_mode(mode),
     m_portnumber(0),
     m_ip_version(ipv),
     m_connect_thread_running(false),
@@ -57,20 +163,31 @@ TcpNodePrivate::TcpNodePrivate(IpVersion ipv)  :
     m_wakeup_listen_thread(false),
     m_changing_listener(false),
     m_connect_timeout(DEFAULT_TIMEOUT_MS),
+    m_resolve_timeout(DEFAULT_RESOLVE_TIMEOUT_MS),
     m_sleep_time(DEFAULT_SLEEPTIME_MS),
-    m_callbackNewPeerConnected(nullptr),
-    m_callbackConnectedToNewPeer(nullptr),
-    m_callbackReceived(nullptr),
-    m_callbackSent(nullptr),
-    m_callbackPeerDisconnected(nullptr),
-    m_callbackClosedConnection(nullptr),
-    m_callbackStartedListening(nullptr),
-    m_callbackStoppedListening(nullptr),
-    m_callbackListenError(nullptr),
-    m_callbackSendError(nullptr),
-    m_callbackConnectError(nullptr),
+    m_fast_open_queue(0),
+    m_send_low_watermark(0),
+    m_send_high_watermark(UNLIMITED_WATERMARK),
+    m_thread_options(),
     m_createNewSocketFunction(nullptr)
 {
+    m_callbacks = new Callbacks();
+    for(auto &reader : m_callback_readers)
+    {
+        reader = 0;
+    }
+
+    if(m_run_mode == RunMode::POLL)
+    {
+        //Without sendThread every sendData()
+        //has to wake up sendPoller.
+        m_send_thread_idle = true;
+#ifdef __linux__
+        m_poll_poller.add(m_connect_poller.fd(), Poller::READABLE);
+        m_poll_poller.add(m_send_poller.fd(), Poller::READABLE);
+#endif
+    }
+
     m_createNewSocketFunction = defaultNewSocket;
     m_listener = m_createNewSocketFunction();
 }
@@ -78,12 +195,18 @@ TcpNodePrivate::TcpNodePrivate(IpVersion ipv)  :
 TcpNodePrivate::~TcpNodePrivate()
 {
     m_destructor_called = true;
+
+    //Let the workers finish the callbacks that are
+    //still queued before the threads are stopped.
+    //Work they request is refused from now on.
+    std::atomic_store(&m_dispatcher, std::shared_ptr<Dispatcher>());
+
     try
     {
         if(m_connect_thread_running)
         {
             m_connect_thread_running = false;
-            m_queue_not_empty.notify_one();
+            m_connect_poller.wakeup();
             if(m_connectThread.joinable())
             {
                 m_connectThread.join();
@@ -93,7 +216,7 @@ TcpNodePrivate::~TcpNodePrivate()
         if(m_send_thread_running)
         {
             m_send_thread_running = false;    
-            m_data_to_send_available.notify_one();
+            m_send_poller.wakeup();
             if(m_sendThread.joinable())
             {
                 m_sendThread.join();
@@ -104,6 +227,7 @@ TcpNodePrivate::~TcpNodePrivate()
         {
             m_listen_thread_running = false;
             m_peers_or_listener_available.notify_one();
+            m_poll_poller.wakeup();
             if(m_listenThread.joinable())
             {
                 m_listenThread.join();
@@ -115,9 +239,232 @@ TcpNodePrivate::~TcpNodePrivate()
         //Ignore exception if it appears
     }
 
+    for(auto &request : m_pending_connects)
+    {
+        _cancelAttempts(request);
+    }
+
     disconnectAll();
     m_listener->close();
     delete m_listener;
+    delete m_callbacks.load();
+}
+
+// Runs a callback posted to a worker with the
+// arguments that were stored for it
+template<typename Callback, typename... Args>
+static void invokeWithStoredArgs(const Callback &callback, Args&... args)
+{
+    callback(std::move(args)...);
+}
+
+template<typename Callback, typename... Args>
+void TcpNodePrivate::_dispatch(
+    uint64_t peer_id,
+    const Callback &callback,
+    Args&&... args)
+{
+    std::shared_ptr<Dispatcher> dispatcher = std::atomic_load(&m_dispatcher);
+
+    if(dispatcher)
+    {
+        dispatcher->post(peer_id, 
+            std::bind(
+                &invokeWithStoredArgs<
+                    Callback, typename std::decay<Args>::type...>,
+                callback, std::forward<Args>(args)...));
+        return;
+    }
+
+    callback(std::forward<Args>(args)...);
+}
+
+const TcpNodePrivate::Callbacks& TcpNodePrivate::_callbacks() const
+{
+    return *m_callbacks.load();
+}
+
+void TcpNodePrivate::_setCallback(
+    const std::function<void(Callbacks&)> &change)
+{
+    Lock lck(m_callback_access);
+    std::unique_ptr<Callbacks> table(new Callbacks(_callbacks()));
+    change(*table);
+
+    const Callbacks *old_table = m_callbacks.exchange(table.release());
+    uint64_t epoch = ++m_callback_epoch;
+    m_retired_callbacks.push_back(
+        RetiredCallbacks{epoch, std::unique_ptr<const Callbacks>(old_table)});
+    _reclaimCallbacks();
+}
+
+void TcpNodePrivate::_reclaimCallbacks()
+{
+    if(m_foreign_callback_readers != 0)
+    {
+        return;
+    }
+
+    //A pass that started in an earlier epoch than
+    //a table was retired in may still be reading it.
+    uint64_t oldest = m_callback_epoch;
+    for(auto &reader : m_callback_readers)
+    {
+        uint64_t epoch = reader;
+        if(epoch != 0 && epoch < oldest)
+        {
+            oldest = epoch;
+        }
+    }
+
+    m_retired_callbacks.erase(
+        std::remove_if(m_retired_callbacks.begin(), m_retired_callbacks.end(),
+            [oldest](const RetiredCallbacks &retired){
+                return retired.epoch <= oldest;
+            }),
+        m_retired_callbacks.end());
+}
+
+TcpNodePrivate::CallbackReadScope::CallbackReadScope(
+    TcpNodePrivate &node,
+    CallbackReader reader) :
+    m_slot(node.m_callback_readers[reader])
+{
+    //Seen before the table is loaded, so a table 
+    //retired after this epoch was read is not freed.
+    m_slot = node.m_callback_epoch.load();
+}
+
+TcpNodePrivate::CallbackReadScope::~CallbackReadScope()
+{
+    m_slot = 0;
+}
+
+void TcpNodePrivate::setCallbackWorkers(size_t worker_count)
+{
+    std::shared_ptr<Dispatcher> dispatcher;
+
+    if(worker_count > 0)
+    {
+        Lock lck(m_data_access);
+        ThreadOptions options = _threadOptions(NodeThread::CALLBACK_WORKERS);
+        lck.unlock();
+        dispatcher = std::make_shared<Dispatcher>(worker_count, options);
+    }
+
+    //The old workers finish their callbacks
+    //when the last reference is gone.
+    std::atomic_store(&m_dispatcher, dispatcher);
+}
+
+bool TcpNodePrivate::setThreadOptions(
+    NodeThread thread,
+    const ThreadOptions &options)
+{
+    Lock lck(m_data_access);
+
+    //sendThread is started without data_access.
+    Lock send_lck(m_send_thread_access, std::defer_lock);
+    if(thread == NodeThread::SEND)
+    {
+        send_lck.lock();
+    }
+
+    _threadOptions(thread) = options;
+    bool applied = true;
+
+    switch(thread)
+    {
+        case NodeThread::LISTEN:
+        case NodeThread::CONNECT:
+        case NodeThread::SEND:
+        {
+            applied = _setupThread(thread);
+            break;
+        }
+        case NodeThread::CALLBACK_WORKERS:
+        {
+            std::shared_ptr<Dispatcher> dispatcher = 
+                std::atomic_load(&m_dispatcher);
+            if(dispatcher)
+            {
+                applied = dispatcher->setThreadOptions(options);
+            }
+            break;
+        }
+        case NodeThread::RESOLVER:
+        {
+            applied = m_resolver.setThreadOptions(options);
+            break;
+        }
+    }
+
+    return applied;
+}
+
+ThreadOptions& TcpNodePrivate::_threadOptions(NodeThread thread)
+{
+    return m_thread_options[static_cast<size_t>(thread)];
+}
+
+std::string TcpNodePrivate::_threadName(NodeThread thread)
+{
+    switch(thread)
+    {
+        case NodeThread::LISTEN:
+        {
+            return "spw-listen";
+        }
+        case NodeThread::CONNECT:
+        {
+            return "spw-connect";
+        }
+        case NodeThread::SEND:
+        {
+            return "spw-send";
+        }
+        default:
+        {
+            return "spw";
+        }
+    }
+}
+
+bool TcpNodePrivate::_setupThread(NodeThread thread)
+{
+    std::thread *running = nullptr;
+
+    switch(thread)
+    {
+        case NodeThread::LISTEN:
+        {
+            running = &m_listenThread;
+            break;
+        }
+        case NodeThread::CONNECT:
+        {
+            running = &m_connectThread;
+            break;
+        }
+        case NodeThread::SEND:
+        {
+            running = &m_sendThread;
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    //A thread that is not running yet applies
+    //its options itself when it is started.
+    if(running == nullptr || !running->joinable())
+    {
+        return true;
+    }
+
+    return setupThread(*running, _threadName(thread), _threadOptions(thread));
 }
 
 void TcpNodePrivate::doListen(uint16_t port, IpVersion ipv)
@@ -133,6 +480,7 @@ void TcpNodePrivate::doListen(uint16_t port, IpVersion ipv)
     m_peers_or_listener_available.notify_one();
 
     _startListenThreadIfNotRunning();
+    _wakeupPoll();
 }
 
 bool TcpNodePrivate::isListening()
@@ -147,614 +495,2316 @@ uint16_t TcpNodePrivate::listenPort()
 
 PeerList TcpNodePrivate::allPeers()
 {
-    Lock lck(m_data_access);
-    return m_peers;
+    return *m_peers.published();
 }
 
-void TcpNodePrivate::onStartedListening(std::function<void(uint16_t)> callback)
+std::shared_ptr<const PeerList> TcpNodePrivate::peerSnapshot()
 {
-    Lock lck(m_callback_access);
-    m_callbackStartedListening = callback;
+    return m_peers.published();
 }
 
-void TcpNodePrivate::onStoppedListening(std::function<void()> callback)
+void TcpNodePrivate::onStartedListening(ListenCallback callback)
 {
-    Lock lck(m_callback_access);
-    m_callbackStoppedListening = callback;
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.startedListening = std::move(callback);
+    });
 }
 
-void TcpNodePrivate::onAccept(std::function<void(Peer pr)> callback)
+void TcpNodePrivate::onStoppedListening(StoppedCallback callback)
 {
-    Lock lck(m_callback_access);
-    m_callbackNewPeerConnected = callback;
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.stoppedListening = std::move(callback);
+    });
+}
+
+void TcpNodePrivate::onAccept(PeerCallback callback)
+{
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.newPeerConnected = std::move(callback);
+    });
 }
 
 void TcpNodePrivate::onReceive(
-    std::function<void(Peer pr, std::vector<uint8_t> bytes)> callback)
+    ReceiveCallback callback)
 {
-    Lock lck(m_callback_access);
-    m_callbackReceived = callback;
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.received = std::move(callback);
+    });
 }
 
-void TcpNodePrivate::onDisconnect(std::function<void(Peer pr)> callback)
+void TcpNodePrivate::onDisconnect(PeerCallback callback)
 {
-    Lock lck(m_callback_access);
-    m_callbackPeerDisconnected = callback;
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.peerDisconnected = std::move(callback);
+    });
 }
 
-void TcpNodePrivate::onClosedConnection(std::function<void(Peer pr)> callback)
+void TcpNodePrivate::onClosedConnection(PeerCallback callback)
 {
-    Lock lck(m_callback_access);
-    m_callbackClosedConnection = callback;
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.closedConnection = std::move(callback);
+    });
 }
 
-void TcpNodePrivate::onConnect(std::function<void(Peer pr)> callback)
+void TcpNodePrivate::onConnect(PeerCallback callback)
 {
-    Lock lck(m_callback_access);
-    m_callbackConnectedToNewPeer = callback;
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.connectedToNewPeer = std::move(callback);
+    });
 }
 
-void TcpNodePrivate::onSend(std::function<void(Peer pr, size_t amount)> callback)
+void TcpNodePrivate::onSend(SentCallback callback)
 {
-    Lock lck(m_callback_access);
-    m_callbackSent = callback;
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.sent = std::move(callback);
+    });
 }
 
-void TcpNodePrivate::onListenError(std::function<void (Message msg)> callback)
+void TcpNodePrivate::onReconnect(PeerCallback callback)
 {
-    Lock lck(m_callback_access);
-    m_callbackListenError = callback;
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.reconnected = std::move(callback);
+    });
 }
 
-void TcpNodePrivate::onSendError(std::function<void (Message msg)> callback)
+void TcpNodePrivate::onWritable(PeerCallback callback)
 {
-    Lock lck(m_callback_access);
-    m_callbackSendError = callback;
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.writable = std::move(callback);
+    });
 }
 
-void TcpNodePrivate::onConnectError(std::function<void (Message msg)> callback)
+void TcpNodePrivate::onListenError(ErrorCallback callback)
 {
-    Lock lck(m_callback_access);
-    m_callbackConnectError = callback;
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.listenError = std::move(callback);
+    });
+}
+
+void TcpNodePrivate::onSendError(ErrorCallback callback)
+{
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.sendError = std::move(callback);
+    });
+}
+
+void TcpNodePrivate::onConnectError(ErrorCallback callback)
+{
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.connectError = std::move(callback);
+    });
 }
 
 void TcpNodePrivate::onFaultyConnectionClosed(
-    std::function<void(Peer pr, Message err)> callback)
+    PeerErrorCallback callback)
 {
-    Lock lck(m_callback_access);
-    m_callbackFaultyConnectionClosed = callback;
+    _setCallback([&callback](Callbacks &cbs){
+        cbs.faultyConnectionClosed = std::move(callback);
+    });
 }
 
 void TcpNodePrivate::stopListening()
 {
-    if(m_listen_thread_running)
+    if(m_listen_thread_running || m_run_mode == RunMode::POLL)
     {
         m_listening_enabled = false;
         m_wakeup_listen_thread = true;
         m_peers_or_listener_available.notify_one();
+        _wakeupPoll();
     }
 }
 
 void TcpNodePrivate::connectTo(const std::string &ipaddr,
                                                 uint16_t port)
+{
+    _queueConnectRequests({ConnectRequest{
+        ipaddr, port, ReconnectPolicy(), false, 0, 0,
+        std::chrono::steady_clock::now(), false, {}, 0, 0}});
+}
+
+void TcpNodePrivate::connectTo(
+    const std::string &ipaddr,
+    uint16_t port,
+    const ReconnectPolicy &policy)
+{
+    _queueConnectRequests({ConnectRequest{
+        ipaddr, port, policy, true, 0, 0,
+        std::chrono::steady_clock::now(), false, {}, 0, 0}});
+}
+
+void TcpNodePrivate::connectTo(
+    const std::string &ipaddr,
+    uint16_t port,
+    const std::vector<uint8_t> &first_data)
+{
+    _queueConnectRequests({ConnectRequest{
+        ipaddr, port, ReconnectPolicy(), false, 0, 0,
+        std::chrono::steady_clock::now(), false, first_data, 0, 0}});
+}
+
+void TcpNodePrivate::connectToAll(
+    const std::vector<Endpoint> &endpoints,
+    std::function<void(std::vector<ConnectResult> results)> completion)
+{
+    if(endpoints.empty())
+    {
+        if(completion)
+        {
+            completion(std::vector<ConnectResult>());
+        }
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    ConnectRequestDeque requests;
+    ConnectBatch batch;
+    batch.remaining = endpoints.size();
+    batch.completion = completion;
+    uint64_t batch_id = ++m_batch_counter;
+
+    for(size_t i = 0; i < endpoints.size(); ++i)
+    {
+        const Endpoint &endpoint = endpoints[i];
+        batch.results.push_back(
+            ConnectResult{endpoint, false, Peer(), Message()});
+        requests.push_back(ConnectRequest{
+            endpoint.host, endpoint.port, ReconnectPolicy(), false, 0, 0,
+            now, false, {}, batch_id, i});
+    }
+
+    _queueConnectRequests(std::move(requests), std::move(batch));
+}
+
+void TcpNodePrivate::_queueConnectRequests(
+    ConnectRequestDeque &&requests,
+    ConnectBatch &&batch)
 {
     Lock lck(m_data_access);
-    if(!m_connect_thread_running)
+    if(batch.remaining > 0)
+    {
+        m_connect_batches[requests.front().batch_id] = std::move(batch);
+    }
+    if(!m_connect_thread_running && m_run_mode == RunMode::THREADS &&
+       !m_destructor_called)
     {
         m_connect_thread_running = true;
-        m_connectThread = std::thread(&TcpNodePrivate::_connectThreadJob, this);
+        m_connectThread = startThread(
+            _threadName(NodeThread::CONNECT),
+            _threadOptions(NodeThread::CONNECT),
+            [this](){_connectThreadJob();});
     }
-    m_potential_peers.push_back(IpAndPort{ipaddr, port});
+    m_potential_peers.insert(m_potential_peers.end(),
+        std::make_move_iterator(requests.begin()),
+        std::make_move_iterator(requests.end()));
     lck.unlock();
-    m_queue_not_empty.notify_one();
+    m_connect_poller.wakeup();
 
     _startListenThreadIfNotRunning();
 }
 
-void TcpNodePrivate::sendData(const Peer &pr, const std::vector<uint8_t> &dat)
+Peer TcpNodePrivate::pooledPeer(const std::string &host, uint16_t port)
 {
+    std::string key = host + ":" + std::to_string(port);
+    auto now = std::chrono::steady_clock::now();
+    Peer result;
+    PooledPeer *chosen = nullptr;
+    size_t least_queued = 0;
+
     Lock lck(m_data_access);
+    PoolEndpoint &endpoint = m_pool[key];
 
-    if(_peerExists(pr.id()))
+    //Pick the healthy connection with the
+    //shortest send queue.
+    for(auto &pooled : endpoint.peers)
     {
-        if(!m_send_thread_running) 
+        Peer candidate;
+        if(!m_peers.find(pooled.id, candidate) || 
+           candidate.m_private->toBeDeleted())
         {
-            m_send_thread_running = true;
-            m_sendThread = std::thread(
-                &TcpNodePrivate::_sendThreadJob,this);
+            continue;
+        }
+
+        auto itqueue = m_data_to_send.find(pooled.id);
+        size_t queued = itqueue != m_data_to_send.end() ? 
+            itqueue->second.queued_bytes : 0;
+
+        if(chosen == nullptr || queued < least_queued)
+        {
+            chosen = &pooled;
+            result = candidate;
+            least_queued = queued;
         }
-            
-        m_data_to_send.push_back({pr.id(), dat});
-        lck.unlock();
-        m_data_to_send_available.notify_one();
     }
-    else
+
+    if(chosen != nullptr)
     {
-        Lock lck(m_callback_access);
-        if(m_callbackSendError) m_callbackSendError(
-            _createErrorMessage(
-                "Send Error", "Cannot send. Not connected to" + pr.ipAddress() + 
-                ":" + std::to_string(pr.port()) + "."));
+        chosen->last_used = now;
+    }
+
+    //Open connections up to the minimum, or one more
+    //if there is none or all of them are busy.
+    size_t open = endpoint.peers.size() + endpoint.connecting;
+    size_t wanted = 0;
+
+    if(open < m_pool_min)
+    {
+        wanted = m_pool_min - open;
+    }
+    else if(open < m_pool_max && (chosen == nullptr || least_queued > 0))
+    {
+        wanted = 1;
+    }
+
+    endpoint.connecting += wanted;
+    lck.unlock();
+
+    for(size_t i = 0; i < wanted; ++i)
+    {
+        _queueConnectRequests({ConnectRequest{
+            host, port, ReconnectPolicy(), false, 0, 0,
+            now, true, {}, 0, 0}});
     }
+
+    return result;
 }
 
-void TcpNodePrivate::_listenThreadJob()
+void TcpNodePrivate::setPoolLimits(
+    size_t min_per_endpoint,
+    size_t max_per_endpoint,
+    int idle_timeout_ms)
 {
-    while(m_listen_thread_running)
+    Lock lck(m_data_access);
+    m_pool_max = std::max<size_t>(max_per_endpoint, 1);
+    m_pool_min = std::min(min_per_endpoint, m_pool_max);
+    m_pool_idle_timeout = idle_timeout_ms;
+}
+
+void TcpNodePrivate::_evictIdlePooledPeers()
+{
+    if(m_pool_idle_timeout <= 0)
     {
-        //Enable or disable listening as requested
-        if(m_listening_enabled && !m_listener_available
-            || m_changing_listener)
-        {
-            Lock lck(m_data_access);
+        return;
+    }
 
-            if(!m_listener->listen(m_portnumber, m_ip_version))
-            {
-                Lock lck(m_callback_access);
-                if(m_callbackListenError)
-                {
-                    Message errmsg =    _createErrorMessage(
-                            "Listen Error", 
-                            "Failed to create listener",
-                            m_listener);
-                    
-                    lck.unlock();
-                    m_callbackListenError(errmsg);
-                    lck.lock();
-                }
+    auto idle_since = std::chrono::steady_clock::now() - 
+        std::chrono::milliseconds(m_pool_idle_timeout);
 
-                m_listener_available = false;
-                m_listening_enabled = false;
-            }
-            else
+    for(auto &endpoint : m_pool)
+    {
+        size_t remaining = endpoint.second.peers.size();
+
+        for(auto &pooled : endpoint.second.peers)
+        {
+            if(remaining <= m_pool_min)
             {
-                m_listener_available = true;
-                
-                Lock lck(m_callback_access);
-                if(m_callbackStartedListening)
-                { 
-                    uint16_t portnum = m_listener->listenPort();
-                    lck.unlock();
-                    m_callbackStartedListening(portnum);
-                    lck.lock();
-                }
+                break;
             }
 
-            m_changing_listener = false;
-        }
-        else if(!m_listening_enabled && m_listener_available)
+            Peer idle;
+            if(pooled.last_used > idle_since ||
+               !m_peers.find(pooled.id, idle) ||
+               idle.m_private->toBeDeleted() ||
+               m_data_to_send.count(pooled.id) != 0)
+            {
+                continue;
+            }
+
+            _schedulePeerDelete(
+                pooled.id, DisconnectType::PEER_WAS_DISCONNECTED);
+            --remaining;
+        }
+    }
+}
+
+void TcpNodePrivate::_removeFromPool(uint64_t peer_id)
+{
+    auto itkey = m_pooled_peer_keys.find(peer_id);
+
+    if(itkey == m_pooled_peer_keys.end())
+    {
+        return;
+    }
+
+    auto &peers = m_pool[itkey->second].peers;
+    peers.erase(std::remove_if(peers.begin(), peers.end(),
+        [peer_id](const PooledPeer &pooled){return pooled.id == peer_id;}),
+        peers.end());
+    m_pooled_peer_keys.erase(itkey);
+}
+
+bool TcpNodePrivate::sendData(
+    const Peer &pr,
+    const std::vector<uint8_t> &dat,
+    Priority priority)
+{
+    return sendData(pr, dat, nullptr, priority);
+}
+
+bool TcpNodePrivate::sendData(
+    const Peer &pr,
+    const std::vector<uint8_t> &dat,
+    SendCompletion completion,
+    Priority priority)
+{
+    OutBuffer ob;
+    ob.data = dat;
+    ob.completion = completion;
+    return _queueOutBuffer(pr, std::move(ob), priority);
+}
+
+bool TcpNodePrivate::sendFile(
+    const Peer &pr,
+    const std::string &path,
+    uint64_t offset,
+    uint64_t length,
+    Priority priority)
+{
+    return sendFile(pr, path, nullptr, offset, length, priority);
+}
+
+bool TcpNodePrivate::sendFile(
+    const Peer &pr,
+    const std::string &path,
+    SendCompletion completion,
+    uint64_t offset,
+    uint64_t length,
+    Priority priority)
+{
+    OutBuffer ob;
+    ob.file_fd = openFileForReading(path);
+    ob.completion = completion;
+
+    if(ob.file_fd == -1)
+    {
+        _failSend(pr, ob,
+            _createErrorMessage(
+                "Send Error", "Cannot open file " + path + "."));
+        return false;
+    }
+
+    return _queueFile(pr, std::move(ob), offset, length, priority, path);
+}
+
+bool TcpNodePrivate::sendFile(
+    const Peer &pr,
+    int fd,
+    uint64_t offset,
+    uint64_t length,
+    Priority priority)
+{
+    return sendFile(pr, fd, nullptr, offset, length, priority);
+}
+
+bool TcpNodePrivate::sendFile(
+    const Peer &pr,
+    int fd,
+    SendCompletion completion,
+    uint64_t offset,
+    uint64_t length,
+    Priority priority)
+{
+    //Work on a duplicate so the caller may
+    //close its descriptor right away.
+    OutBuffer ob;
+    ob.file_fd = fd != -1 ? duplicateFile(fd) : -1;
+    ob.completion = completion;
+
+    if(ob.file_fd == -1)
+    {
+        _failSend(pr, ob,
+            _createErrorMessage(
+                "Send Error", "Cannot use file descriptor " +
+                std::to_string(fd) + "."));
+        return false;
+    }
+
+    return _queueFile(pr, std::move(ob), offset, length, priority,
+                      "with descriptor " + std::to_string(fd));
+}
+
+bool TcpNodePrivate::_queueFile(
+    const Peer &pr,
+    OutBuffer &&ob,
+    uint64_t offset,
+    uint64_t length,
+    Priority priority,
+    const std::string &name)
+{
+    uint64_t file_size = 0;
+
+    if(!fileSize(ob.file_fd, file_size) || offset > file_size)
+    {
+        _failSend(pr, ob,
+            _createErrorMessage(
+                "Send Error", "Cannot send file " + name + 
+                ". Offset is beyond the end of the file."));
+        return false;
+    }
+
+    if(length == 0 || length > file_size - offset)
+    {
+        length = file_size - offset;
+    }
+
+    if(length == 0)
+    {
+        if(ob.completion)
         {
-            Lock lck(m_data_access);
-            m_listener->close();
-            m_listener_available = false;
+            ob.completion(pr, true);
+        }
+        return true;
+    }
+
+    ob.file_offset = offset;
+    ob.file_remaining = length;
+
+    return _queueOutBuffer(pr, std::move(ob), priority);
+}
+
+bool TcpNodePrivate::_queueOutBuffer(
+    const Peer &pr,
+    OutBuffer &&ob,
+    Priority priority)
+{
+    std::shared_ptr<SendState> state;
+    if(pr.m_private)
+    {
+        state = pr.m_private->sendState();
+    }
 
-            Lock lck2(m_callback_access);
-            if(m_callbackStoppedListening)
+    if(m_destructor_called)
+    {
+        _failSend(pr, ob,
+            _createErrorMessage(
+                "Send Error", "Cannot send. TcpNode is being destroyed."));
+        return false;
+    }
+
+    if(!state || !state->open)
+    {
+        _failSend(pr, ob,
+            _createErrorMessage(
+                "Send Error", "Cannot send. Not connected to" + pr.ipAddress() + 
+                ":" + std::to_string(pr.port()) + "."));
+        return false;
+    }
+
+    //Producers that check at the same time may
+    //overshoot the high watermark by a message each.
+    size_t queued_bytes = state->queued_bytes;
+    if(ob.file_fd == -1 && priority != Priority::URGENT &&
+       queued_bytes > 0 && queued_bytes >= m_send_high_watermark)
+    {
+        state->notify_writable = true;
+        _failSend(pr, ob,
+            _createErrorMessage(
+                "Send Error", "Cannot send. Send queue of " + pr.ipAddress() +
+                ":" + std::to_string(pr.port()) + " is full (" +
+                std::to_string(queued_bytes) + " bytes queued)."));
+        return false;
+    }
+
+    if(ob.file_fd == -1)
+    {
+        state->queued_bytes += ob.data.size();
+    }
+
+    _startSendThreadIfNotRunning();
+    m_submissions.push(Submission{pr, std::move(ob), priority, 
+                                  Submission::DATA, Coalescing{0, 0}});
+
+    //A busy sendThread finds the message
+    //on its next pass without a wakeup.
+    if(m_send_thread_idle)
+    {
+        m_send_poller.wakeup();
+    }
+
+    return true;
+}
+
+void TcpNodePrivate::_startSendThreadIfNotRunning()
+{
+    if(m_send_thread_running || m_run_mode == RunMode::POLL)
+    {
+        return;
+    }
+
+    Lock lck(m_send_thread_access);
+    if(!m_send_thread_running && !m_destructor_called) 
+    {
+        m_send_thread_running = true;
+        m_sendThread = startThread(
+            _threadName(NodeThread::SEND),
+            _threadOptions(NodeThread::SEND),
+            [this](){_sendThreadJob();});
+    }
+}
+
+void TcpNodePrivate::_takeSubmissions()
+{
+    Submission sub;
+
+    while(m_submissions.pop(sub))
+    {
+        uint64_t peer_id = sub.pr.id();
+
+        if(sub.kind == Submission::FLUSH)
+        {
+            auto itqueue = m_data_to_send.find(peer_id);
+            if(itqueue != m_data_to_send.end())
+            {
+                itqueue->second.flush_requested = true;
+            }
+            continue;
+        }
+        else if(sub.kind == Submission::COALESCING)
+        {
+            if(sub.coalescing.window_us == 0)
+            {
+                m_coalescing.erase(peer_id);
+            }
+            else if(_peerExists(peer_id))
             {
-                lck.unlock();
-                m_callbackStoppedListening();
-                lck.lock();
+                m_coalescing[peer_id] = sub.coalescing;
             }
+            continue;
+        }
+
+        size_t bytes = sub.ob.file_fd == -1 ? sub.ob.data.size() : 0;
+        auto itheld = m_held_queues.find(peer_id);
+        bool reconnecting = itheld != m_held_queues.end();
+
+        if(!_peerExists(peer_id) && !reconnecting)
+        {
+            sub.pr.m_private->sendState()->queued_bytes -= bytes;
+            _abandonOutBuffer(sub.ob, sub.pr);
+
+            _reportSendError(
+                _createErrorMessage(
+                    "Send Error", "Cannot send. Not connected to" + 
+                    sub.pr.ipAddress() + ":" + 
+                    std::to_string(sub.pr.port()) + "."));
+            continue;
+        }
+
+        //While a Peer reconnects its data is held
+        //back until the new connection is up.
+        OutBufferQueue &queue = reconnecting ? 
+            itheld->second : m_data_to_send[peer_id];
+
+        if(!queue.send_state)
+        {
+            queue.send_state = sub.pr.m_private->sendState();
+        }
+
+        //The first message of a coalescing peer
+        //starts the window. URGENT data ends it.
+        auto itcoalescing = m_coalescing.find(peer_id);
+        if(queue.empty() && itcoalescing != m_coalescing.end())
+        {
+            queue.coalescing = true;
+            queue.hold_until = std::chrono::steady_clock::now() +
+                std::chrono::microseconds(itcoalescing->second.window_us);
+            queue.hold_bytes = itcoalescing->second.max_bytes;
         }
 
+        if(sub.priority == Priority::URGENT)
+        {
+            queue.flush_requested = true;
+        }
+
+        queue.queued_bytes += bytes;
+        queue.buffers[static_cast<size_t>(sub.priority)].push_back(
+            std::move(sub.ob));
+    }
+}
+
+std::shared_ptr<SendState> TcpNodePrivate::_openSendState(uint64_t peer_id)
+{
+    std::shared_ptr<SendState> &state = m_send_states[peer_id];
+
+    if(!state)
+    {
+        state = std::make_shared<SendState>();
+    }
+
+    state->open = true;
+    return state;
+}
+
+void TcpNodePrivate::_closeSendState(uint64_t peer_id, bool reconnecting)
+{
+    auto itstate = m_send_states.find(peer_id);
+
+    if(itstate == m_send_states.end())
+    {
+        return;
+    }
+
+    //Data is held for a Peer that replays its
+    //queue, so sendData() may go on meanwhile.
+    if(reconnecting)
+    {
+        itstate->second->open = m_held_queues.count(peer_id) != 0;
+        return;
+    }
+
+    itstate->second->open = false;
+    m_send_states.erase(itstate);
+}
+
+void TcpNodePrivate::setSendWatermarks(size_t low, size_t high)
+{
+    m_send_low_watermark = std::min(low, high);
+    m_send_high_watermark = high;
+}
+
+size_t TcpNodePrivate::queuedBytes(const Peer &pr)
+{
+    std::shared_ptr<SendState> state;
+    if(pr.m_private)
+    {
+        state = pr.m_private->sendState();
+    }
+    return state ? state->queued_bytes.load() : 0;
+}
+
+void TcpNodePrivate::setCoalescing(
+    const Peer &pr,
+    uint32_t window_us,
+    size_t max_bytes)
+{
+    //Goes the way of the data, so callbacks
+    //may call it while data_access is held.
+    m_submissions.push(Submission{pr, OutBuffer(), Priority::NORMAL,
+                                  Submission::COALESCING, 
+                                  Coalescing{window_us, max_bytes}});
+}
+
+void TcpNodePrivate::flush(const Peer &pr)
+{
+    //Queued behind the data sent before, so 
+    //sendThread cannot see the flush too early.
+    m_submissions.push(Submission{pr, OutBuffer(), Priority::NORMAL,
+                                  Submission::FLUSH, Coalescing{0, 0}});
+    m_send_poller.wakeup();
+}
+
+void TcpNodePrivate::_listenThreadJob()
+{
+    std::vector<Poller::Event> events;
+    auto last_work = std::chrono::steady_clock::now();
+
+    while(m_listen_thread_running)
+    {
+        _updateListener();
         m_wakeup_listen_thread = false;
 
         _pauseUntilPeersOrListenerAvailable();
 
-        if(m_destructor_called)
+        if(m_destructor_called)
+        {
+            break;
+        }
+
+        bool had_work = false;
+        _receivePass(had_work);
+
+        //With busy polling the thread keeps going while
+        //there was work within the budget, and only
+        //parks when it has been idle for longer.
+        auto now = std::chrono::steady_clock::now();
+        if(had_work)
+        {
+            last_work = now;
+        }
+
+        //Parked until a socket is readable. Work that
+        //no socket announces, like a Peer scheduled for
+        //deletion by sendThread, waits a sleep time at most.
+        if(now - last_work >= std::chrono::microseconds(m_busy_poll_us))
+        {
+            m_poll_poller.wait(events, m_sleep_time);
+        }
+    }
+}
+
+void TcpNodePrivate::_updateListener()
+{
+    CallbackReadScope reading(*this, LISTEN_READER);
+
+    //Enable or disable listening as requested
+    if(m_listening_enabled && !m_listener_available
+        || m_changing_listener)
+    {
+        Lock lck(m_data_access);
+
+        m_listener->setFastOpenQueue(m_fast_open_queue);
+        if(!m_listener->listen(m_portnumber, m_ip_version))
+        {
+            const Callbacks &callbacks = _callbacks();
+            if(callbacks.listenError)
+            {
+                Message errmsg =    _createErrorMessage(
+                        "Listen Error", 
+                        "Failed to create listener",
+                        m_listener);
+                
+                callbacks.listenError(errmsg);
+            }
+
+            m_listener_available = false;
+            m_listening_enabled = false;
+        }
+        else
+        {
+            m_listener_available = true;
+            _watchSocket(m_listener);
+            
+            const Callbacks &callbacks = _callbacks();
+            if(callbacks.startedListening)
+            { 
+                uint16_t portnum = m_listener->listenPort();
+                callbacks.startedListening(portnum);
+            }
+        }
+
+        m_changing_listener = false;
+    }
+    else if(!m_listening_enabled && m_listener_available)
+    {
+        Lock lck(m_data_access);
+        _unwatchSocket(m_listener);
+        m_listener->close();
+        m_listener_available = false;
+
+        const Callbacks &callbacks = _callbacks();
+        if(callbacks.stoppedListening)
+        {
+            lck.unlock();
+            callbacks.stoppedListening();
+            lck.lock();
+        }
+    }
+}
+
+bool TcpNodePrivate::_receivePass(bool &had_work)
+{
+    CallbackReadScope reading(*this, LISTEN_READER);
+    Lock lck(m_data_access);
+
+    //Listen for new connections if listening
+    //is enabled
+    if(m_listener->isListener() && 
+         m_listener->isListening() &&
+         m_listener_available)
+    {
+        ISocket *new_peer = m_listener->accept();
+        int errornum = 0;
+
+        if(new_peer)
+        {
+            had_work = true;
+            if(m_busy_poll_us > 0)
+            {
+                new_peer->setBusyPoll(m_busy_poll_us);
+            }
+
+            uint64_t current_count = ++m_connection_counter;
+            Peer np(new PeerPrivate());
+            np.m_private->set(
+                current_count,
+                new_peer->peerIpAddress(),
+                new_peer->peerPort(),
+                new_peer->peerName());
+            np.m_private->setSocket(new_peer);
+            np.m_private->setValid(true);
+            np.m_private->setSendState(_openSendState(current_count));
+            m_peers.insert(np);
+            _watchSocket(new_peer);
+            
+            const Callbacks &callbacks = _callbacks();
+            if(callbacks.newPeerConnected)
+            { 
+                _dispatch(current_count, callbacks.newPeerConnected, np);
+            }
+        }
+        else if((errornum = m_listener->getLastErrno()) != 0)
+        {
+            const Callbacks &callbacks = _callbacks();
+            if(callbacks.listenError)
+            {
+                Message errmsg = _createErrorMessage(
+                    "Listen Error", "Failed to accept", errornum);
+                callbacks.listenError(errmsg);
+            }
+        }
+    }
+     
+    //Listen for incoming data from active connections.
+    //The published list is only copied again after Peers
+    //came or went. Its Peers share their state with the
+    //table, and only the listen thread removes Peers, so
+    //their sockets stay valid meanwhile.
+    std::shared_ptr<const PeerList> peers = m_peers.published();
+
+    for(auto &s : *peers)
+    {
+        if(s.second.m_private->toBeDeleted())
+        {
+            continue;
+        }
+
+        std::vector<uint8_t> recdata;
+        ISocket::ReceiveResult recres = 
+                ISocket::ReceiveResult::ERROR_NO_CONNECTION;
+        
+        ISocket *psock = s.second.m_private->getSocket();
+        if(psock)
+        {
+            if(psock->isConnected())
+            {
+                recres = psock->receive(recdata);
+            }
+        }
+        
+        Message errmsg;
+        bool failed = true;
+        DisconnectType disconn = 
+            DisconnectType::PEER_WAS_DISCONNECTED_DUE_TO_ERROR;
+
+        switch(recres)
+        {
+            case ISocket::ReceiveResult::OK:
+            {
+                failed = false;
+                had_work = true;
+                const Callbacks &callbacks = _callbacks();
+                if(callbacks.received)
+                {
+                    _dispatch(s.first, callbacks.received, 
+                              s.second, std::move(recdata));
+                }
+                break;
+            }
+            case ISocket::ReceiveResult::ERROR_NO_CONNECTION:
+            {
+                errmsg = _createErrorMessage("Receive Error", "Socket is not connected.");
+                break;
+            }
+            case ISocket::ReceiveResult::ERROR_IS_LISTENER:
+            {
+                errmsg = _createErrorMessage("Receive Error", "Socket is a listener.");
+                break;
+            }
+            case ISocket::ReceiveResult::ERROR_PEER_DISCONNECTED:
+            {
+                disconn = DisconnectType::PEER_DISCONNECTED_THEMSELF;
+                break;
+            }
+            case ISocket::ReceiveResult::ERROR_SYSTEM:
+            {
+                errmsg = _createErrorMessage(
+                    "Receive Error", "Failed to receive.", s.second.m_private->getSocket());
+                break;
+            }
+            case ISocket::ReceiveResult::ERROR_NOTHING_RECEIVED:
+            {
+                //Do nothing
+                failed = false;
+                break;
+            }
+        }
+
+        if(failed)
+        {
+            _schedulePeerDelete(s.first, disconn, errmsg);
+        }
+    }
+
+    _evictIdlePooledPeers();
+
+    //Delete next peer scheduled for deletion
+    Peer temp;
+    bool more_to_delete = false;
+    m_peers.forEach([&temp, &more_to_delete](Peer &stored){
+        if(stored.m_private->toBeDeleted())
+        {
+            if(temp.id() == 0)
+            {
+                temp = stored;
+            }
+            else
+            {
+                more_to_delete = true;
+            }
+        }
+    });
+
+    if(temp.id() != 0)
+    {
+        had_work = true;
+        uint64_t peer_id = temp.id();
+        _closeSendState(peer_id, _scheduleReconnect(temp));
+        _removeFromPool(peer_id);
+        auto itqueue = m_data_to_send.find(peer_id);
+        if(itqueue != m_data_to_send.end())
+        {
+            _dropSendQueue(itqueue, temp);
+        }
+        m_coalescing.erase(peer_id);
+        m_peers.erase(peer_id);
+        _unwatchSocket(temp.m_private->getSocket());
+        temp.m_private->destroySocket();
+
+        const Callbacks &callbacks = _callbacks();
+
+        if(temp.m_private->disconnectType() == 
+             DisconnectType::PEER_DISCONNECTED_THEMSELF &&
+             callbacks.peerDisconnected)
+        {
+            _dispatch(peer_id, callbacks.peerDisconnected, temp);
+        }
+        else if(callbacks.closedConnection &&
+                        temp.m_private->disconnectType() == 
+                        DisconnectType::PEER_WAS_DISCONNECTED)
+        {
+            _dispatch(peer_id, callbacks.closedConnection, temp);
+        }
+        else if(callbacks.faultyConnectionClosed &&
+                        temp.m_private->disconnectType() ==
+                        DisconnectType::PEER_WAS_DISCONNECTED_DUE_TO_ERROR)
+        {
+            _dispatch(peer_id, callbacks.faultyConnectionClosed, 
+                      temp, temp.m_private->getErrorMessage());
+        }
+    }
+
+    lck.unlock();
+    _runSendCompletions();
+
+    return more_to_delete;
+}
+
+void TcpNodePrivate::_startListenThreadIfNotRunning()
+{
+    if(!m_listen_thread_running && m_run_mode == RunMode::THREADS &&
+       !m_destructor_called)
+    {
+        m_listen_thread_running = true;
+        Lock lck(m_data_access);
+        m_listenThread = startThread(
+            _threadName(NodeThread::LISTEN),
+            _threadOptions(NodeThread::LISTEN),
+            [this](){_listenThreadJob();});
+    }
+}
+
+void TcpNodePrivate::_connectThreadJob()
+{
+    std::vector<Poller::Event> events;
+
+    while(m_connect_thread_running)
+    {
+        int timeout_ms = _connectPass(events);
+        m_connect_poller.wait(events, timeout_ms);
+    }
+}
+
+int TcpNodePrivate::_connectPass(const std::vector<Poller::Event> &ready_fds)
+{
+    CallbackReadScope reading(*this, CONNECT_READER);
+    //Take all requests at once, so every
+    //attempt is in flight at the same time.
+    ConnectRequestDeque requests;
+    std::vector<ResolveResult> results;
+    Lock lck(m_data_access);
+    requests.swap(m_potential_peers);
+    results.swap(m_resolved);
+    lck.unlock();
+
+    //Reconnects wait until their delay is over.
+    int timeout_ms = -1;
+    auto now = std::chrono::steady_clock::now();
+    m_connect_waiting.insert(
+        m_connect_waiting.end(), requests.begin(), requests.end());
+    auto itwaiting = m_connect_waiting.begin();
+
+    while(itwaiting != m_connect_waiting.end())
+    {
+        if(itwaiting->due > now)
+        {
+            timeout_ms = earlierTimeout(timeout_ms, static_cast<int>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    itwaiting->due - now).count()) + 1);
+            ++itwaiting;
+            continue;
+        }
+
+        if(Resolver::isNumericAddress(itwaiting->host))
+        {
+            _startConnect(m_pending_connects, *itwaiting, {itwaiting->host});
+        }
+        else
+        {
+            _startResolve(m_resolving, *itwaiting);
+        }
+
+        itwaiting = m_connect_waiting.erase(itwaiting);
+    }
+
+    timeout_ms = earlierTimeout(timeout_ms, 
+        _finishResolves(m_resolving, m_pending_connects, results));
+    return earlierTimeout(
+        timeout_ms, _finishConnects(m_pending_connects, ready_fds));
+}
+
+void TcpNodePrivate::_startConnect(
+    PendingConnectList &pending,
+    const ConnectRequest &origin,
+    const std::vector<std::string> &addresses)
+{
+    PendingConnect request;
+    request.origin = origin;
+    request.deadline = std::chrono::steady_clock::now() + 
+        std::chrono::milliseconds(m_connect_timeout);
+    request.error = _createErrorMessage(
+        "Connect Error", 
+        "Failed to connect to " + origin.host + ":" + 
+        std::to_string(origin.port));
+
+    //Alternate between the address families, starting
+    //with the family of the first address.
+    std::deque<std::string> ipv6;
+    std::deque<std::string> ipv4;
+
+    for(auto &address : addresses)
+    {
+        if(address.find(':') != std::string::npos)
+        {
+            ipv6.push_back(address);
+        }
+        else
+        {
+            ipv4.push_back(address);
+        }
+    }
+
+    bool take_ipv6 = !addresses.empty() && 
+                     addresses.front().find(':') != std::string::npos;
+
+    while(!ipv6.empty() || !ipv4.empty())
+    {
+        std::deque<std::string> &family = 
+            (take_ipv6 && !ipv6.empty()) || ipv4.empty() ? ipv6 : ipv4;
+        request.addresses.push_back(family.front());
+        family.pop_front();
+        take_ipv6 = !take_ipv6;
+    }
+
+    pending.push_back(std::move(request));
+}
+
+ISocket* TcpNodePrivate::_startNextAttempt(PendingConnect &request)
+{
+    std::string address = request.addresses.front();
+    request.addresses.pop_front();
+    request.next_attempt = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(CONNECTION_ATTEMPT_DELAY_MS);
+
+    ISocket *new_peer = m_createNewSocketFunction();
+    bool started = false;
+
+    //Only the first attempt uses Fast Open,
+    //so the data is not sent twice.
+    if(!request.origin.fast_open_data.empty() &&
+       !request.fast_open_tried)
+    {
+        request.fast_open_tried = true;
+        request.fast_open_socket = new_peer;
+        started = new_peer->startFastOpenConnect(
+            address, request.origin.port,
+            request.origin.fast_open_data, request.fast_open_sent);
+    }
+    else
+    {
+        started = new_peer->startConnect(address, request.origin.port);
+    }
+
+    if(!started)
+    {
+        if(request.fast_open_socket == new_peer)
+        {
+            request.fast_open_socket = nullptr;
+            request.fast_open_sent = 0;
+        }
+        request.error = _createErrorMessage(
+            "Connect Error", 
+            "Failed to connect to " + address + ":" + 
+            std::to_string(request.origin.port),
+            new_peer);
+        delete new_peer;
+        return nullptr;
+    }
+
+    if(new_peer->isConnected())
+    {
+        return new_peer;
+    }
+
+    int32_t fd = new_peer->socketNumber();
+
+    if(!m_connect_poller.add(fd, Poller::WRITABLE))
+    {
+        fd = -1;
+    }
+
+    request.attempts.push_back(ConnectAttempt{new_peer, address, fd});
+    return nullptr;
+}
+
+void TcpNodePrivate::_cancelAttempts(PendingConnect &request)
+{
+    for(auto &attempt : request.attempts)
+    {
+        if(attempt.fd != -1)
+        {
+            m_connect_poller.remove(attempt.fd);
+        }
+
+        delete attempt.socket;
+    }
+
+    request.attempts.clear();
+}
+
+void TcpNodePrivate::_startResolve(
+    PendingResolveList &resolving,
+    const ConnectRequest &origin)
+{
+    uint64_t id = ++m_resolve_counter;
+
+    resolving.push_back(PendingResolve{
+        id, origin,
+        std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(m_resolve_timeout)});
+
+    m_resolver.resolve(origin.host, origin.port, 
+        [this, id](std::vector<std::string> addresses, std::string error){
+            Lock lck(m_data_access);
+            m_resolved.push_back(ResolveResult{id, addresses, error});
+            lck.unlock();
+            m_connect_poller.wakeup();
+        });
+}
+
+int TcpNodePrivate::_finishResolves(
+    PendingResolveList &resolving,
+    PendingConnectList &pending,
+    const std::vector<ResolveResult> &results)
+{
+    for(auto &result : results)
+    {
+        auto itresolving = std::find_if(resolving.begin(), resolving.end(),
+            [&result](const PendingResolve &res){return res.id == result.id;});
+
+        //Already timed out.
+        if(itresolving == resolving.end())
+        {
+            continue;
+        }
+
+        if(result.addresses.empty())
+        {
+            _connectFailed(itresolving->origin,
+                _createErrorMessage(
+                    "Connect Error",
+                    "Failed to resolve " + itresolving->origin.host + ": " +
+                    result.error));
+        }
+        else
+        {
+            _startConnect(pending, itresolving->origin, result.addresses);
+        }
+
+        resolving.erase(itresolving);
+    }
+
+    int timeout_ms = -1;
+    auto now = std::chrono::steady_clock::now();
+    auto itresolving = resolving.begin();
+
+    while(itresolving != resolving.end())
+    {
+        if(now >= itresolving->deadline)
+        {
+            _connectFailed(itresolving->origin,
+                _createErrorMessage(
+                    "Connect Error",
+                    "Resolving " + itresolving->origin.host + " timed out"));
+            itresolving = resolving.erase(itresolving);
+            continue;
+        }
+
+        timeout_ms = earlierTimeout(timeout_ms, static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                itresolving->deadline - now).count()) + 1);
+        ++itresolving;
+    }
+
+    return timeout_ms;
+}
+
+void TcpNodePrivate::_reportConnectError(const Message &errmsg)
+{
+    const Callbacks &callbacks = _callbacks();
+    if(callbacks.connectError)
+    {
+        callbacks.connectError(errmsg);
+    }
+}
+
+int TcpNodePrivate::_finishConnects(
+    PendingConnectList &pending,
+    const std::vector<Poller::Event> &ready_fds)
+{
+    int timeout_ms = -1;
+    auto itrequest = pending.begin();
+
+    while(itrequest != pending.end())
+    {
+        PendingConnect &request = *itrequest;
+        ISocket *winner = nullptr;
+        auto itattempt = request.attempts.begin();
+
+        while(winner == nullptr && itattempt != request.attempts.end())
+        {
+            bool ready = itattempt->fd == -1;
+
+            for(auto &ev : ready_fds)
+            {
+                ready = ready || ev.fd == itattempt->fd;
+            }
+
+            int errornum = 0;
+
+            if(ready && itattempt->socket->finishConnect())
+            {
+                winner = itattempt->socket;
+            }
+            else if(ready && 
+                    (errornum = itattempt->socket->getLastErrno()) != 0)
+            {
+                request.error = _createErrorMessage(
+                    "Connect Error", 
+                    "Failed to connect to " + 
+                    itattempt->address + ":" + 
+                    std::to_string(request.origin.port),
+                    errornum);
+
+                if(itattempt->socket == request.fast_open_socket)
+                {
+                    request.fast_open_socket = nullptr;
+                    request.fast_open_sent = 0;
+                }
+                delete itattempt->socket;
+            }
+            else
+            {
+                ++itattempt;
+                continue;
+            }
+
+            if(itattempt->fd != -1)
+            {
+                m_connect_poller.remove(itattempt->fd);
+            }
+
+            itattempt = request.attempts.erase(itattempt);
+        }
+
+        //Start the next address when the earlier
+        //ones failed or are taking too long.
+        auto now = std::chrono::steady_clock::now();
+
+        while(winner == nullptr && !request.addresses.empty() &&
+              (request.attempts.empty() || now >= request.next_attempt))
+        {
+            winner = _startNextAttempt(request);
+        }
+
+        if(winner != nullptr)
+        {
+            _cancelAttempts(request);
+
+            //Whatever did not go out with the
+            //SYN is sent before anything else.
+            ConnectRequest &origin = request.origin;
+            if(winner == request.fast_open_socket)
+            {
+                origin.fast_open_data.erase(
+                    origin.fast_open_data.begin(),
+                    origin.fast_open_data.begin() + 
+                    std::min(request.fast_open_sent, 
+                             origin.fast_open_data.size()));
+            }
+
+            _completeConnect(winner, origin);
+            itrequest = pending.erase(itrequest);
+            continue;
+        }
+
+        if(request.attempts.empty() || now >= request.deadline)
+        {
+            _cancelAttempts(request);
+            _connectFailed(request.origin, request.error);
+            itrequest = pending.erase(itrequest);
+            continue;
+        }
+
+        auto next_event = request.deadline;
+        if(!request.addresses.empty() && request.next_attempt < next_event)
+        {
+            next_event = request.next_attempt;
+        }
+
+        int remaining_ms = static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                next_event - now).count()) + 1;
+
+        for(auto &attempt : request.attempts)
+        {
+            if(attempt.fd == -1)
+            {
+                remaining_ms = std::min<int>(remaining_ms, m_sleep_time);
+            }
+        }
+
+        timeout_ms = earlierTimeout(timeout_ms, remaining_ms);
+        ++itrequest;
+    }
+
+    return timeout_ms;
+}
+
+void TcpNodePrivate::_completeConnect(
+    ISocket *socket,
+    const ConnectRequest &origin)
+{
+    Lock lck(m_data_access);
+    uint64_t current_count = origin.peer_id != 0 ? 
+        origin.peer_id : ++m_connection_counter;
+    Peer pr(new PeerPrivate());
+    pr.m_private->set(
+        current_count,
+        socket->peerIpAddress(),
+        socket->peerPort(),
+        socket->peerName());
+    pr.m_private->setSocket(socket);
+    pr.m_private->setValid(true);
+    pr.m_private->setSendState(_openSendState(current_count));
+
+    if(m_busy_poll_us > 0)
+    {
+        socket->setBusyPoll(m_busy_poll_us);
+    }
+
+    //Callback workers get onConnect() before the Peer 
+    //is visible to _receivePass(), so it is queued 
+    //ahead of every onReceive() of the Peer.
+    const Callbacks &callbacks = _callbacks();
+    const PeerCallback &connected = origin.peer_id != 0 ?
+        callbacks.reconnected : callbacks.connectedToNewPeer;
+    bool posted = false;
+
+    if(connected && std::atomic_load(&m_dispatcher))
+    {
+        _dispatch(current_count, connected, pr);
+        posted = true;
+    }
+
+    m_peers.insert(pr);
+    _watchSocket(socket);
+
+    if(origin.pooled)
+    {
+        std::string key = origin.host + ":" + std::to_string(origin.port);
+        PoolEndpoint &endpoint = m_pool[key];
+        endpoint.connecting -= std::min<size_t>(endpoint.connecting, 1);
+        endpoint.peers.push_back(PooledPeer{
+            current_count, std::chrono::steady_clock::now()});
+        m_pooled_peer_keys[current_count] = key;
+    }
+
+    if(origin.reconnect)
+    {
+        ConnectRequest &persistent = m_persistent_peers[current_count];
+        persistent = origin;
+        persistent.peer_id = current_count;
+        persistent.attempt = 0;
+        persistent.fast_open_data.clear();
+    }
+
+    //Replay what was queued while reconnecting.
+    auto itheld = m_held_queues.find(current_count);
+    bool replay = itheld != m_held_queues.end();
+    if(replay)
+    {
+        m_data_to_send[current_count] = std::move(itheld->second);
+        m_held_queues.erase(itheld);
+    }
+
+    if(!origin.fast_open_data.empty())
+    {
+        OutBufferQueue &queue = m_data_to_send[current_count];
+        OutBuffer ob;
+        ob.data = origin.fast_open_data;
+        queue.send_state = pr.m_private->sendState();
+        queue.send_state->queued_bytes += ob.data.size();
+        queue.queued_bytes += ob.data.size();
+        queue.buffers[static_cast<size_t>(Priority::URGENT)].push_front(
+            std::move(ob));
+        replay = true;
+    }
+
+    if(replay)
+    {
+        _startSendThreadIfNotRunning();
+    }
+    lck.unlock();
+
+    if(replay)
+    {
+        m_send_poller.wakeup();
+    }
+
+    if(connected && !posted)
+    {
+        _dispatch(current_count, connected, pr);
+    }
+    m_peers_or_listener_available.notify_one();
+
+    _finishBatchEntry(origin, true, pr, Message());
+}
+
+void TcpNodePrivate::_finishBatchEntry(
+    const ConnectRequest &origin,
+    bool connected,
+    const Peer &pr,
+    const Message &errmsg)
+{
+    if(origin.batch_id == 0)
+    {
+        return;
+    }
+
+    Lock lck(m_data_access);
+    auto itbatch = m_connect_batches.find(origin.batch_id);
+    if(itbatch == m_connect_batches.end())
+    {
+        return;
+    }
+
+    ConnectBatch &batch = itbatch->second;
+    ConnectResult &result = batch.results[origin.batch_index];
+    result.connected = connected;
+    result.peer = pr;
+    result.error = errmsg;
+
+    if(--batch.remaining > 0)
+    {
+        return;
+    }
+
+    ConnectBatch finished = std::move(batch);
+    m_connect_batches.erase(itbatch);
+    lck.unlock();
+
+    if(finished.completion)
+    {
+        finished.completion(std::move(finished.results));
+    }
+}
+
+void TcpNodePrivate::_connectFailed(
+    const ConnectRequest &origin,
+    const Message &errmsg)
+{
+    _reportConnectError(errmsg);
+    _finishBatchEntry(origin, false, Peer(), errmsg);
+
+    if(origin.pooled)
+    {
+        Lock lck(m_data_access);
+        PoolEndpoint &endpoint = 
+            m_pool[origin.host + ":" + std::to_string(origin.port)];
+        endpoint.connecting -= std::min<size_t>(endpoint.connecting, 1);
+    }
+
+    if(!origin.reconnect)
+    {
+        return;
+    }
+
+    ConnectRequest retry = origin;
+    ++retry.attempt;
+    Lock lck(m_data_access);
+
+    if(origin.policy.max_attempts > 0 && 
+       retry.attempt >= origin.policy.max_attempts)
+    {
+        //Give up. Held data will never be sent.
+        _closeSendState(origin.peer_id, false);
+        auto itheld = m_held_queues.find(origin.peer_id);
+        if(itheld != m_held_queues.end())
+        {
+            for(size_t cls = 0; cls < OutBufferQueue::CLASS_COUNT; ++cls)
+            {
+                for(auto &ob : itheld->second.buffers[cls])
+                {
+                    _abandonOutBuffer(ob, Peer());
+                }
+            }
+            m_held_queues.erase(itheld);
+        }
+        lck.unlock();
+        _runSendCompletions();
+        return;
+    }
+
+    retry.due = std::chrono::steady_clock::now() + _reconnectDelay(retry);
+    m_potential_peers.push_back(retry);
+    lck.unlock();
+    m_connect_poller.wakeup();
+}
+
+std::chrono::milliseconds TcpNodePrivate::_reconnectDelay(
+    const ConnectRequest &origin)
+{
+    static thread_local std::mt19937 generator(std::random_device{}());
+
+    const ReconnectPolicy &policy = origin.policy;
+    //Multiplied once per failed attempt, so the retry
+    //after a lost connection waits initial_delay_ms.
+    double delay = std::min<double>(
+        policy.initial_delay_ms * std::pow(policy.multiplier, origin.attempt),
+        policy.max_delay_ms);
+
+    //Take a random part off, so nodes that lost
+    //their remote at the same time spread out.
+    double jitter = std::min(std::max(policy.jitter, 0.0), 1.0);
+    std::uniform_real_distribution<double> distribution(0.0, jitter);
+    delay -= delay * distribution(generator);
+
+    return std::chrono::milliseconds(static_cast<int64_t>(std::max(delay, 0.0)));
+}
+
+bool TcpNodePrivate::_scheduleReconnect(const Peer &pr)
+{
+    auto itpersistent = m_persistent_peers.find(pr.id());
+
+    if(itpersistent == m_persistent_peers.end())
+    {
+        return false;
+    }
+
+    ConnectRequest retry = itpersistent->second;
+    m_persistent_peers.erase(itpersistent);
+
+    if(pr.m_private->disconnectType() == 
+       DisconnectType::PEER_WAS_DISCONNECTED)
+    {
+        return false;
+    }
+
+    auto itqueue = m_data_to_send.find(pr.id());
+    if(itqueue != m_data_to_send.end() && retry.policy.replay_queue)
+    {
+        //A message that went out partly cannot be
+        //continued on another connection.
+        OutBufferQueue &queue = itqueue->second;
+        if(queue.in_flight != OutBufferQueue::NO_CLASS)
+        {
+            OutBuffer &partial = queue.buffers[queue.in_flight].front();
+            if(partial.file_fd == -1)
+            {
+                queue.releaseBytes(
+                    partial.data.size() - partial.data_offset);
+            }
+            _abandonOutBuffer(partial, pr);
+            queue.popFront(queue.in_flight);
+        }
+
+        if(queue.waiting_fd != -1)
+        {
+            m_send_poller.remove(queue.waiting_fd);
+            m_send_waiting.erase(queue.waiting_fd);
+        }
+
+        queue.waiting_for_writable = false;
+        queue.waiting_fd = -1;
+        m_held_queues[pr.id()] = std::move(queue);
+        m_data_to_send.erase(itqueue);
+    }
+    else if(retry.policy.replay_queue)
+    {
+        m_held_queues[pr.id()];
+    }
+
+    retry.attempt = 0;
+    retry.due = std::chrono::steady_clock::now() + _reconnectDelay(retry);
+    m_potential_peers.push_back(retry);
+    m_connect_poller.wakeup();
+    return true;
+}
+
+void TcpNodePrivate::_sendThreadJob()
+{
+    std::vector<Poller::Event> events;
+
+    while(m_send_thread_running)
+    {
+        int timeout_ms = _sendPass(events);
+
+        //Producers only wake sendThread while it is
+        //idle. Checking for submissions after going
+        //idle catches those that came in just before.
+        m_send_thread_idle = true;
+        _waitForSendWork(events, timeout_ms);
+        m_send_thread_idle = false;
+    }
+}
+
+int TcpNodePrivate::_sendPass(const std::vector<Poller::Event> &ready_fds)
+{
+    CallbackReadScope reading(*this, SEND_READER);
+    Lock lck(m_data_access);
+
+    //Sockets that became writable (or failed) 
+    //are written again in this pass.
+    for(auto &ev : ready_fds)
+    {
+        auto itwaiting = m_send_waiting.find(ev.fd);
+        if(itwaiting == m_send_waiting.end())
+        {
+            continue;
+        }
+
+        auto itqueue = m_data_to_send.find(itwaiting->second);
+        if(itqueue != m_data_to_send.end())
+        {
+            itqueue->second.waiting_for_writable = false;
+            itqueue->second.waiting_fd = -1;
+        }
+
+        m_send_poller.remove(ev.fd);
+        m_send_waiting.erase(itwaiting);
+    }
+
+    _takeSubmissions();
+    int timeout_ms = _sendQueuedData();
+    lck.unlock();
+
+    _runSendCompletions();
+    return timeout_ms;
+}
+
+int TcpNodePrivate::_sendQueuedData()
+{
+    int timeout_ms = -1;
+    OutBufferList::iterator itqueue = m_data_to_send.begin();
+
+    while(itqueue != m_data_to_send.end())
+    {
+        Peer peer;
+
+        if(!m_peers.find(itqueue->first, peer))
+        {
+            _reportSendError(
+                _createErrorMessage("Send Error",
+                "Specified peer does not exist."));
+
+            itqueue = _dropSendQueue(itqueue, Peer());
+            continue;
+        }
+        else if(peer.m_private->toBeDeleted())
+        {
+            itqueue = _dropSendQueue(itqueue, peer);
+            continue;
+        }
+
+        OutBufferQueue &queue = itqueue->second;
+
+        if(queue.waiting_for_writable)
+        {
+            if(queue.waiting_fd != -1)
+            {
+                ++itqueue;
+                continue;
+            }
+
+            //Sockets that cannot be watched are
+            //simply tried again after a sleep time.
+            queue.waiting_for_writable = false;
+        }
+
+        //Hold back the messages of a coalescing peer
+        //until its window is over or enough has piled up.
+        if(queue.coalescing && !queue.flush_requested &&
+           queue.in_flight == OutBufferQueue::NO_CLASS &&
+           (queue.hold_bytes == 0 || queue.queued_bytes < queue.hold_bytes))
+        {
+            auto now = std::chrono::steady_clock::now();
+
+            if(now < queue.hold_until)
+            {
+                auto hold_us = std::chrono::duration_cast<
+                    std::chrono::microseconds>(queue.hold_until - now);
+                int hold_ms = static_cast<int>((hold_us.count() + 999) / 1000);
+                timeout_ms = earlierTimeout(timeout_ms, hold_ms);
+                ++itqueue;
+                continue;
+            }
+        }
+
+        //Write until the socket is full, the queue is 
+        //empty or the peer has used up its share of this
+        //pass. Only the front of a peer's queue is written,
+        //so the messages of one peer always leave in the
+        //order they were queued.
+        ISocket *psocket = peer.m_private->getSocket();
+        uint64_t budget = SEND_BUDGET_PER_PASS;
+        bool would_block = false;
+        int send_errno = 0;
+        bool failed = false;
+
+        if(queue.coalescing)
+        {
+            psocket->setCorked(true);
+        }
+
+        while(!queue.empty() && budget > 0)
+        {
+            size_t cls = queue.nextClass();
+            OutBuffer &curr_out_buffer = queue.buffers[cls].front();
+            bool in_memory = curr_out_buffer.file_fd == -1;
+            bool complete = false;
+            size_t bytes_sent = _writeOutBuffer(
+                psocket, curr_out_buffer, complete);
+
+            if(bytes_sent > 0)
+            {
+                budget -= std::min<uint64_t>(bytes_sent, budget);
+
+                if(in_memory)
+                {
+                    queue.releaseBytes(bytes_sent);
+                }
+
+                const Callbacks &callbacks = _callbacks();
+                if(callbacks.sent)
+                {
+                    _dispatch(itqueue->first, callbacks.sent, 
+                              peer, bytes_sent);
+                }
+            }
+            else if(!complete)
+            {
+                send_errno = psocket->getLastErrno();
+                failed = send_errno != 0;
+                would_block = !failed;
+                break;
+            }
+
+            if(complete)
+            {
+                if(curr_out_buffer.completion)
+                {
+                    m_finished_sends.push_back(FinishedSend{
+                        peer,
+                        std::move(curr_out_buffer.completion),
+                        true});
+                }
+
+                queue.popFront(cls);
+            }
+            else
+            {
+                queue.in_flight = cls;
+            }
+        }
+
+        //Uncorking pushes out what is left
+        //of the last partial segment.
+        if(queue.coalescing)
+        {
+            psocket->setCorked(false);
+        }
+
+        if(failed)
         {
-            break;
+            Message errmsg = _createErrorMessage(
+                                "Send Error", "Sending Failed", send_errno);
+            _schedulePeerDelete(itqueue->first,
+                DisconnectType::PEER_WAS_DISCONNECTED_DUE_TO_ERROR, errmsg);
+            itqueue = _dropSendQueue(itqueue, peer);
+            continue;
         }
 
-        Lock lck(m_data_access);
+        //Tell producers that were turned away
+        //that the queue has drained far enough.
+        if(queue.send_state && queue.send_state->notify_writable &&
+           queue.send_state->queued_bytes <= m_send_low_watermark)
+        {
+            queue.send_state->notify_writable = false;
 
-        //Listen for new connections if listening
-        //is enabled
-        if(m_listener->isListener() && 
-             m_listener->isListening() &&
-             m_listener_available)
-        {
-            ISocket *new_peer = m_listener->accept();
-
-            if(new_peer)
-            {
-                uint64_t current_count = ++m_connection_counter;
-                Peer np;
-                np.m_private->set(
-                    current_count,
-                    new_peer->peerIpAddress(),
-                    new_peer->peerPort(),
-                    new_peer->peerName());
-                np.m_private->setSocket(new_peer);
-                np.m_private->setValid(true);
-                m_peers.insert({current_count, np});
-                
-                Lock lck(m_callback_access);
-                if(m_callbackNewPeerConnected)
-                { 
-                    lck.unlock();
-                    m_callbackNewPeerConnected(np);
-                    lck.lock();
-                }
-            }
-            else if(m_listener->getLastErrno() != 0)
+            const Callbacks &callbacks = _callbacks();
+            if(callbacks.writable)
             {
-                Lock lck(m_callback_access);
-                if(m_callbackListenError)
-                {
-                    Message errmsg = _createErrorMessage(
-                        "Listen Error", "Failed to accept", m_listener);
-                    lck.unlock();
-                    m_callbackListenError(errmsg);
-                    lck.lock();
-                }
+                _dispatch(itqueue->first, callbacks.writable, peer);
             }
         }
-         
-        //Listen for incoming data from active connections
-        for(auto &s : m_peers)
+
+        if(would_block)
         {
-            if(s.second.m_private->toBeDeleted())
-            {
-                continue;
-            }
+            int32_t fd = psocket->socketNumber();
+            queue.waiting_for_writable = true;
 
-            std::vector<uint8_t> recdata;
-            ISocket::ReceiveResult recres = 
-                    ISocket::ReceiveResult::ERROR_NO_CONNECTION;
-            
-            ISocket *psock = s.second.m_private->getSocket();
-            if(psock)
+            if(m_send_poller.add(fd, Poller::WRITABLE))
             {
-                if(psock->isConnected())
-                {
-                    recres = psock->receive(recdata);
-                }
+                queue.waiting_fd = fd;
+                m_send_waiting[fd] = itqueue->first;
             }
-            
-            Lock lck(m_callback_access);
-
-            switch(recres)
+            else
             {
-                case ISocket::ReceiveResult::OK:
-                {
-                    if(m_callbackReceived)
-                    {
-                        lck.unlock();
-                        m_callbackReceived(s.second, recdata);
-                        lck.lock();
-                    }
-                    break;
-                }
-                case ISocket::ReceiveResult::ERROR_NO_CONNECTION:
-                {
-                    s.second.m_private->scheduleDelete(DisconnectType::PEER_WAS_DISCONNECTED_DUE_TO_ERROR);
-                    s.second.m_private->setErrorMessage(
-                        _createErrorMessage("Receive Error", "Socket is not connected."));
-                    break;
-                }
-                case ISocket::ReceiveResult::ERROR_IS_LISTENER:
-                {
-                    s.second.m_private->scheduleDelete(DisconnectType::PEER_WAS_DISCONNECTED_DUE_TO_ERROR);
-                    s.second.m_private->setErrorMessage(
-                        _createErrorMessage("Receive Error", "Socket is a listener."));
-                    break;
-                }
-                case ISocket::ReceiveResult::ERROR_PEER_DISCONNECTED:
-                {
-                    s.second.m_private->scheduleDelete(DisconnectType::PEER_DISCONNECTED_THEMSELF);
-                    break;
-                }
-                case ISocket::ReceiveResult::ERROR_SYSTEM:
-                {
-                    s.second.m_private->scheduleDelete(DisconnectType::PEER_WAS_DISCONNECTED_DUE_TO_ERROR);
-                    s.second.m_private->setErrorMessage(_createErrorMessage(
-                        "Receive Error", "Failed to receive.", s.second.m_private->getSocket()));
-                    break;
-                }
-                case ISocket::ReceiveResult::ERROR_NOTHING_RECEIVED:
-                {
-                    //Do nothing
-                    break;
-                }
+                timeout_ms = earlierTimeout(timeout_ms, m_sleep_time);
             }
         }
+        else if(!queue.empty())
+        {
+            //Budget used up. Continue right after
+            //the other peers had their turn.
+            timeout_ms = 0;
+        }
 
-        //Delete next peer scheduled for deletion
-        for(auto &s : m_peers)
+        if(queue.empty())
         {
-            if(s.second.m_private->toBeDeleted())
-            {
-                Peer temp = s.second;
-                s.second.m_private->destroySocket();
-                m_peers.erase(s.first);
+            itqueue = _dropSendQueue(itqueue, peer);
+        }
+        else
+        {
+            ++itqueue;
+        }
+    }
 
-                Lock lck(m_callback_access);
+    return timeout_ms;
+}
 
-                if(temp.m_private->disconnectType() == 
-                     DisconnectType::PEER_DISCONNECTED_THEMSELF &&
-                     m_callbackPeerDisconnected)
-                {
-                    lck.unlock();
-                    m_callbackPeerDisconnected(temp);
-                    lck.lock();
-                }
-                else if(m_callbackClosedConnection &&
-                                temp.m_private->disconnectType() == 
-                                DisconnectType::PEER_WAS_DISCONNECTED)
-                {
-                    lck.unlock();
-                    m_callbackClosedConnection(temp);
-                    lck.lock();
-                }
-                else if(m_callbackFaultyConnectionClosed &&
-                                temp.m_private->disconnectType() ==
-                                DisconnectType::PEER_WAS_DISCONNECTED_DUE_TO_ERROR)
-                {
-                    lck.unlock();
-                    m_callbackFaultyConnectionClosed(temp, temp.m_private->getErrorMessage());
-                    lck.lock();
-                }
-                break;
-            }
+bool TcpNodePrivate::OutBufferQueue::empty() const
+{
+    for(size_t cls = 0; cls < CLASS_COUNT; ++cls)
+    {
+        if(!buffers[cls].empty())
+        {
+            return false;
         }
-     
-        lck.unlock();
-        std::this_thread::sleep_for(std::chrono::milliseconds(m_sleep_time));
     }
+
+    return true;
 }
 
-void TcpNodePrivate::_startListenThreadIfNotRunning()
+size_t TcpNodePrivate::OutBufferQueue::nextClass() const
 {
-    if(!m_listen_thread_running)
+    if(in_flight != NO_CLASS)
     {
-        m_listen_thread_running = true;
-        Lock lck(m_data_access);
-        m_listenThread = 
-        std::thread(&TcpNodePrivate::_listenThreadJob, this);
+        return in_flight;
+    }
+
+    for(size_t cls = CLASS_COUNT; cls-- > 0;)
+    {
+        if(!buffers[cls].empty() && starved[cls] >= STARVATION_LIMIT)
+        {
+            return cls;
+        }
+    }
+
+    for(size_t cls = 0; cls < CLASS_COUNT; ++cls)
+    {
+        if(!buffers[cls].empty())
+        {
+            return cls;
+        }
     }
+
+    return NO_CLASS;
 }
 
-void TcpNodePrivate::_connectThreadJob()
+void TcpNodePrivate::OutBufferQueue::releaseBytes(size_t bytes)
 {
-    size_t queue_length = 0;
+    bytes = std::min(bytes, queued_bytes);
+    queued_bytes -= bytes;
 
-    while(m_connect_thread_running)
+    if(send_state)
     {
-        Lock lck(m_data_access);
-        queue_length = m_potential_peers.size();
-        lck.unlock();
+        send_state->queued_bytes -= bytes;
+    }
+}
+
+void TcpNodePrivate::OutBufferQueue::popFront(size_t cls)
+{
+    buffers[cls].pop_front();
+    in_flight = NO_CLASS;
+    starved[cls] = 0;
 
-        if(queue_length <= 0)
+    for(size_t lower = cls + 1; lower < CLASS_COUNT; ++lower)
+    {
+        if(!buffers[lower].empty())
         {
-            _pauseUntilQueueNotEmpty();
-            continue;
+            ++starved[lower];
         }
+    }
+}
 
-        for(size_t i = 0; i < queue_length; ++i)
-        {
-            ISocket *new_peer = m_createNewSocketFunction();
-            lck.lock();
-            std::string ip = m_potential_peers.front().first;
-            uint16_t port = m_potential_peers.front().second;
-            lck.unlock();
+TcpNodePrivate::OutBufferList::iterator TcpNodePrivate::_dropSendQueue(
+    OutBufferList::iterator itqueue,
+    const Peer &pr)
+{
+    OutBufferQueue &queue = itqueue->second;
 
-            bool timeup = false;
-            int errornum = 0;
-            bool connect_success = false;
-            auto elapsed = std::chrono::duration<double>(0);
-
-            do
-            {
-                connect_success = new_peer->connect(ip, port);
-                errornum = new_peer->getLastErrno();
-                auto begin = std::chrono::high_resolution_clock::now();
-                std::this_thread::sleep_for(
-                    std::chrono::milliseconds(m_sleep_time));
-                auto end = std::chrono::high_resolution_clock::now();
-                elapsed += (end - begin);
-                timeup = std::chrono::duration_cast<std::chrono::milliseconds>
-                                 (elapsed).count() >= m_connect_timeout;
-            }while(!connect_success && 
-                        errornum == 0 &&
-                        !timeup);
-
-            if(!connect_success)
-            {
-                Lock lck(m_callback_access);
-                if(m_callbackConnectError)
-                {
-                    m_callbackConnectError(
-                        _createErrorMessage(
-                                "Connect Error", 
-                                "Failed to connect to " + ip + ":"
-                                + std::to_string(port),
-                                new_peer));
-                }
+    if(queue.waiting_fd != -1)
+    {
+        m_send_poller.remove(queue.waiting_fd);
+        m_send_waiting.erase(queue.waiting_fd);
+    }
 
-                delete new_peer;
-            }
-            else
-            {
-                lck.lock();
-                uint64_t current_count = ++m_connection_counter;
-                Peer pr;
-                pr.m_private->set(
-                    current_count,
-                    new_peer->peerIpAddress(),
-                    new_peer->peerPort(),
-                    new_peer->peerName());
-                pr.m_private->setSocket(new_peer);
-                pr.m_private->setValid(true);
-
-                m_peers.insert({current_count, pr});
-                lck.unlock();
-
-                Lock lck(m_callback_access);
-                if(m_callbackConnectedToNewPeer)
-                {
-                    m_callbackConnectedToNewPeer(pr);
-                }
-                m_peers_or_listener_available.notify_one();
-            }
+    for(size_t cls = 0; cls < OutBufferQueue::CLASS_COUNT; ++cls)
+    {
+        for(auto &ob : queue.buffers[cls])
+        {
+            _abandonOutBuffer(ob, pr);
         }
-
-        lck.lock();
-        m_potential_peers.pop_front();
-        lck.unlock();
     }
-    
+
+    queue.releaseBytes(queue.queued_bytes);
+    return m_data_to_send.erase(itqueue);
 }
 
-void TcpNodePrivate::_sendThreadJob()
+void TcpNodePrivate::_abandonOutBuffer(OutBuffer &ob, const Peer &pr)
 {
-    while(m_send_thread_running)
+    if(ob.completion)
     {
-        Lock lck(m_data_access);
-        uint8_t to_send_count = m_data_to_send.size();
+        m_finished_sends.push_back(
+            FinishedSend{pr, std::move(ob.completion), false});
+    }
+}
+
+void TcpNodePrivate::_runSendCompletions()
+{
+    std::vector<FinishedSend> finished_sends;
+    Lock lck(m_data_access);
+    finished_sends.swap(m_finished_sends);
+    lck.unlock();
+
+    std::shared_ptr<Dispatcher> dispatcher = std::atomic_load(&m_dispatcher);
 
-        if(to_send_count <= 0)
+    for(auto &finished : finished_sends)
+    {
+        if(dispatcher)
         {
-            lck.unlock();
-            _pauseUntilDataToSendAvailable();
-            lck.lock();
+            dispatcher->post(finished.pr.id(), std::bind(
+                finished.completion, finished.pr, finished.success));
         }
-     
-        if(m_data_to_send.size() > 0)
+        else
         {
-            OutBufferList::iterator curr_out_buffer;
-            curr_out_buffer = m_data_to_send.begin();
-            auto itpeer = m_peers.find(curr_out_buffer->first);
-
-            if(itpeer == m_peers.end())
-            {
-                Lock lck(m_callback_access);
-                if(m_callbackSendError)
-                {
-                    lck.unlock();// Unlock for callback ///////
-                    m_callbackSendError(
-                    _createErrorMessage("Send Error",
-                    "Specified peer does not exist."));
-                    lck.lock();
-                }                
-            }
-            else if(!itpeer->second.m_private->toBeDeleted())
-            {
-                ISocket *psocket = itpeer->second.m_private->getSocket();
-                size_t bytes_sent = psocket->send(curr_out_buffer->second);
-                if(bytes_sent > 0)
-                {
-                    Lock lck(m_callback_access);
-                    if(m_callbackSent)
-                    {
-                        Peer pr = itpeer->second;
-                        lck.unlock();// Unlock for callback ///////
-                        m_callbackSent(pr, bytes_sent);
-                        lck.lock();
-                    }
-                }
-                else
-                {
-                    if(m_callbackSendError)
-                    {
-                        Message errmsg = _createErrorMessage(
-                                            "Send Error", "Sending Failed", psocket);
-                        itpeer->second.m_private->setErrorMessage(errmsg);
-                        itpeer->second.m_private->scheduleDelete(
-                            DisconnectType::PEER_WAS_DISCONNECTED_DUE_TO_ERROR);
-                    }
-                }
-            }
-
-            m_data_to_send.pop_front();
+            finished.completion(finished.pr, finished.success);
         }
-        
-    lck.unlock();
+    }
+}
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(DEFAULT_SLEEPTIME_MS));
+size_t TcpNodePrivate::_writeOutBuffer(
+    ISocket *psocket,
+    OutBuffer &ob,
+    bool &complete)
+{
+    size_t bytes_sent = 0;
+    complete = false;
 
+    if(ob.file_fd != -1)
+    {
+        size_t chunk_size = static_cast<size_t>(
+            std::min(ob.file_remaining, FILE_CHUNK_SIZE));
+        bytes_sent = psocket->sendFile(
+            ob.file_fd, ob.file_offset, chunk_size);
+        bytes_sent = static_cast<size_t>(
+            std::min<uint64_t>(bytes_sent, ob.file_remaining));
+
+        ob.file_offset += bytes_sent;
+        ob.file_remaining -= bytes_sent;
+        complete = ob.file_remaining == 0;
+    }
+    else
+    {
+        //After a partial write only the rest is sent,
+        //without moving it to the front of data.
+        size_t remaining = ob.data.size() - ob.data_offset;
+        bytes_sent = psocket->sendBytes(
+            ob.data.data() + ob.data_offset, remaining);
+        bytes_sent = std::min(bytes_sent, remaining);
+
+        ob.data_offset += bytes_sent;
+        complete = ob.data_offset == ob.data.size();
     }
+
+    return bytes_sent;
 }
 
 void TcpNodePrivate::_pauseUntilPeersOrListenerAvailable()
 {
-    Lock lck(m_data_access);
-    m_peers_or_listener_available.wait(
-        lck, [this](){return !m_peers.empty() || 
+    auto available = [this](){return !m_peers.empty() || 
         m_listener_available || m_destructor_called ||
-        m_changing_listener || m_wakeup_listen_thread;});
+        m_changing_listener || m_wakeup_listen_thread;};
+
+    //Spin before going to sleep on the condition.
+    auto spin_end = std::chrono::steady_clock::now() +
+        std::chrono::microseconds(m_busy_poll_us);
+    while(std::chrono::steady_clock::now() < spin_end)
+    {
+        if(available())
+        {
+            return;
+        }
+    }
+
+    Lock lck(m_data_access);
+    m_peers_or_listener_available.wait(lck, available);
 }
 
-void TcpNodePrivate::_pauseUntilQueueNotEmpty()
+void TcpNodePrivate::_waitForSendWork(
+    std::vector<Poller::Event> &events, 
+    int timeout_ms)
 {
-    Lock lck(m_data_access);
-    m_queue_not_empty.wait(lck, [this](){
-        return !m_potential_peers.empty() || m_destructor_called;});
+    auto begin = std::chrono::steady_clock::now();
+    auto spin_end = begin + std::chrono::microseconds(m_busy_poll_us);
+    auto now = begin;
+
+    //Spin on submissions and sendPoller
+    //first, then block for the rest.
+    while(now < spin_end)
+    {
+        bool woken = false;
+        if(!m_submissions.empty())
+        {
+            events.clear();
+            return;
+        }
+
+        if(m_send_poller.wait(events, 0, &woken) > 0 || woken)
+        {
+            return;
+        }
+
+        now = std::chrono::steady_clock::now();
+        if(timeout_ms != -1 && 
+           now - begin >= std::chrono::milliseconds(timeout_ms))
+        {
+            return;
+        }
+    }
+
+    if(!m_submissions.empty())
+    {
+        events.clear();
+        return;
+    }
+
+    if(timeout_ms != -1)
+    {
+        timeout_ms -= static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                now - begin).count());
+        timeout_ms = std::max(timeout_ms, 0);
+    }
+
+    m_send_poller.wait(events, timeout_ms);
 }
 
-void TcpNodePrivate::_pauseUntilDataToSendAvailable()
+void TcpNodePrivate::setBusyPoll(uint32_t spin_us)
 {
-    Lock lck(m_data_access);
-    m_data_to_send_available.wait(lck, [this](){
-        return !m_data_to_send.empty() || m_destructor_called;});
+    m_busy_poll_us = spin_us;
+
+    m_peers.forEach([spin_us](Peer &stored){
+        ISocket *socket = stored.m_private->getSocket();
+        if(socket)
+        {
+            socket->setBusyPoll(spin_us);
+        }
+    });
 }
 
 void TcpNodePrivate::disconnectPeer(const Peer &pr)
 {
-    Lock lck(m_data_access);
-    if(_peerExists(pr.id()))
-    {
-        m_peers.at(pr.id()).m_private->scheduleDelete(
+    m_peers.update(pr.id(), [](Peer &stored){
+        if(stored.isValid())
+        {
+            stored.m_private->scheduleDelete(
+                DisconnectType::PEER_WAS_DISCONNECTED);
+        }
+    });
+    _wakeupPoll();
+}
+
+void TcpNodePrivate::disconnectAll()
+{
+    m_peers.forEach([](Peer &stored){
+        stored.m_private->scheduleDelete(
             DisconnectType::PEER_WAS_DISCONNECTED);
+    });
+    _wakeupPoll();
+}
+
+void TcpNodePrivate::poll(int timeout_ms)
+{
+    std::vector<Poller::Event> events;
+    int wait_ms = m_poll_due;
+
+    if(timeout_ms >= 0 && (wait_ms == -1 || timeout_ms < wait_ms))
+    {
+        wait_ms = timeout_ms;
+    }
+
+#ifdef _WIN32
+    //WSAPoll() cannot watch connectPoller and
+    //sendPoller, so they are checked in slices.
+    if(wait_ms == -1 || wait_ms > m_sleep_time)
+    {
+        wait_ms = m_sleep_time;
     }
+#endif
+
+    m_poll_poller.wait(events, wait_ms);
+
+    _updateListener();
+    m_wakeup_listen_thread = false;
+    bool had_work = false;
+    bool more_to_delete = _receivePass(had_work);
+
+    m_connect_poller.wait(events, 0);
+    int connect_due = _connectPass(events);
+
+    m_send_poller.wait(events, 0);
+    int send_due = _sendPass(events);
+
+    m_poll_due = more_to_delete ? 0 : earlierTimeout(connect_due, send_due);
 }
 
-void TcpNodePrivate::disconnectAll()
+int TcpNodePrivate::pollDescriptor()
 {
-    Lock lck(m_data_access);
+#ifdef __linux__
+    if(m_run_mode == RunMode::POLL)
+    {
+        return m_poll_poller.fd();
+    }
+#endif
+    return -1;
+}
+
+int TcpNodePrivate::pollTimeout()
+{
+    return m_poll_due;
+}
+
+void TcpNodePrivate::processEvents()
+{
+    poll(0);
+}
+
+void TcpNodePrivate::_watchSocket(ISocket *socket)
+{
+    if(socket)
+    {
+        m_poll_poller.add(socket->socketNumber(), Poller::READABLE);
+    }
+}
 
-    for(PeerList::iterator itpeer = m_peers.begin();
-            itpeer != m_peers.end();
-            ++itpeer)
+void TcpNodePrivate::_unwatchSocket(ISocket *socket)
+{
+    if(socket)
     {
-        itpeer->second.m_private->scheduleDelete(
-            DisconnectType::PEER_WAS_DISCONNECTED);
+        m_poll_poller.remove(socket->socketNumber());
     }
 }
 
+void TcpNodePrivate::_wakeupPoll()
+{
+    m_poll_poller.wakeup();
+}
+
 Message TcpNodePrivate::_createErrorMessage(
     const std::string &h,
     const std::string &b,
     ISocket *sock)
+{
+    return _createErrorMessage(h, b, sock ? sock->getLastErrno() : 0);
+}
+
+Message TcpNodePrivate::_createErrorMessage(
+    const std::string &h,
+    const std::string &b,
+    int errornum)
 {
     Message m{h, b};
-    if(sock)
+    if(errornum != 0)
     {
-        int last_errno = sock->getLastErrno();
-        
-        if(last_errno != 0)
-        {
-            m.body += "\nError number " + std::to_string(last_errno) + " :"
-                         + sock->getLastErrnoString();
-        }
+        m.body += "\nError number " + std::to_string(errornum) + " :"
+                     + Socket::errnoString(errornum);
     }
     return m;
 }
 
-bool TcpNodePrivate::_peerExists(uint64_t peer_id)
+void TcpNodePrivate::_failSend(
+    const Peer &pr,
+    OutBuffer &ob,
+    const Message &errmsg)
 {
-    auto itpeer = m_peers.find(peer_id);
-    bool exists = false;
+    _reportSendError(errmsg);
+
+    if(ob.completion)
+    {
+        ob.completion(pr, false);
+    }
+}
 
-    if(itpeer != m_peers.end())
+void TcpNodePrivate::_reportSendError(const Message &errmsg)
+{
+    //Also called by sendData() on the threads of the user.
+    ++m_foreign_callback_readers;
+    const Callbacks &callbacks = _callbacks();
+    if(callbacks.sendError)
     {
-        if(itpeer->second.isValid())
+        callbacks.sendError(errmsg);
+    }
+    --m_foreign_callback_readers;
+}
+
+void TcpNodePrivate::_schedulePeerDelete(
+    uint64_t peer_id,
+    DisconnectType dt,
+    const Message &errmsg)
+{
+    m_peers.update(peer_id, [dt, &errmsg](Peer &stored){
+        stored.m_private->scheduleDelete(dt);
+        if(!errmsg.head.empty())
         {
-            exists = true;
+            stored.m_private->setErrorMessage(errmsg);
         }
-    }
+    });
+}
 
-    return exists;
+bool TcpNodePrivate::_peerExists(uint64_t peer_id)
+{
+    Peer pr;
+    return m_peers.find(peer_id, pr) && pr.isValid();
 }
 
 int TcpNodePrivate::connectTimeout()
@@ -767,6 +2817,34 @@ void TcpNodePrivate::setConnectTimeout(int ms)
     m_connect_timeout = ms;
 }
 
+int TcpNodePrivate::resolveTimeout()
+{
+    return m_resolve_timeout;
+}
+
+void TcpNodePrivate::setResolveTimeout(int ms)
+{
+    m_resolve_timeout = ms;
+}
+
+void TcpNodePrivate::setFastOpen(int queue_length)
+{
+    m_fast_open_queue = std::max(queue_length, 0);
+}
+
+void TcpNodePrivate::setResolveCache(
+    int ttl_ms,
+    int negative_ttl_ms,
+    size_t max_entries)
+{
+    m_resolver.setCache(ttl_ms, negative_ttl_ms, max_entries);
+}
+
+void TcpNodePrivate::invalidateResolveCache(const std::string &host)
+{
+    m_resolver.invalidate(host);
+}
+
 void TcpNodePrivate::setSleepTime(int ms)
 {
     m_sleep_time = ms;
@@ -796,25 +2874,16 @@ void TcpNodePrivate::setReceiveBufferSize(size_t number_of_bytes)
 
 Peer TcpNodePrivate::latestPeer()
 {
-    Lock lck(m_data_access);
-    if(!m_peers.empty())
-    {
-        uint64_t max = 0;
-        for(auto &elem : m_peers)
+    Peer latest;
+
+    m_peers.forEach([&latest](Peer &stored){
+        if(stored.id() > latest.id())
         {
-            uint64_t current = elem.first;
-            if(current > max)
-            {
-                max = current;
-            }
+            latest = stored;
         }
+    });
 
-        return m_peers.at(max);
-    }
-    else
-    {
-        return Peer();
-    }
+    return latest;
 }
 
 ISocket* TcpNodePrivate::defaultNewSocket()
@@ -34,12 +34,19 @@ SOFTWARE.
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <chrono>
+#include <memory>
 #include "../include/Peer.hpp"
 #include "../src/PeerPrivate.hpp"
 #include <functional> 
 #include <unordered_map>
 #include "../include/common.hpp"
 #include "ISocket.hpp"
+#include "Poller.hpp"
+#include "Resolver.hpp"
+#include "MpscQueue.hpp"
+#include "PeerTable.hpp"
+#include "Dispatcher.hpp"
 
 struct addrinfo;
 
@@ -51,7 +58,8 @@ class TcpNodePrivate
 
 public:
 
-    TcpNodePrivate(IpVersion ipv = IpVersion::ANY);
+    TcpNodePrivate(IpVersion ipv = IpVersion::ANY, 
+                   RunMode mode = RunMode::THREADS);
     TcpNodePrivate(const TcpNodePrivate &other) = delete;
     virtual ~TcpNodePrivate();
 
@@ -65,62 +73,756 @@ public:
     void connectTo(
         const std::string &ipaddr,
         uint16_t port);
-    void sendData(
+    void connectTo(
+        const std::string &ipaddr,
+        uint16_t port,
+        const ReconnectPolicy &policy);
+    void connectTo(
+        const std::string &ipaddr,
+        uint16_t port,
+        const std::vector<uint8_t> &first_data);
+    void connectToAll(
+        const std::vector<Endpoint> &endpoints,
+        std::function<void(std::vector<ConnectResult> results)> completion);
+    Peer pooledPeer(const std::string &host, uint16_t port);
+    void setPoolLimits(
+        size_t min_per_endpoint,
+        size_t max_per_endpoint,
+        int idle_timeout_ms);
+    bool sendData(
+        const Peer &pr,
+        const std::vector<uint8_t> &dat,
+        Priority priority = Priority::NORMAL);
+    bool sendData(
         const Peer &pr,
-        const std::vector<uint8_t> &dat);
+        const std::vector<uint8_t> &dat,
+        SendCompletion completion,
+        Priority priority = Priority::NORMAL);
+    bool sendFile(
+        const Peer &pr,
+        const std::string &path,
+        uint64_t offset = 0,
+        uint64_t length = 0,
+        Priority priority = Priority::NORMAL);
+    bool sendFile(
+        const Peer &pr,
+        const std::string &path,
+        SendCompletion completion,
+        uint64_t offset = 0,
+        uint64_t length = 0,
+        Priority priority = Priority::NORMAL);
+    bool sendFile(
+        const Peer &pr,
+        int fd,
+        uint64_t offset = 0,
+        uint64_t length = 0,
+        Priority priority = Priority::NORMAL);
+    bool sendFile(
+        const Peer &pr,
+        int fd,
+        SendCompletion completion,
+        uint64_t offset = 0,
+        uint64_t length = 0,
+        Priority priority = Priority::NORMAL);
+    void setSendWatermarks(size_t low, size_t high);
+    size_t queuedBytes(const Peer &pr);
+    void setCoalescing(const Peer &pr, uint32_t window_us, size_t max_bytes = 0);
+    void flush(const Peer &pr);
     uint16_t listenPort();
     void setReceiveBufferSize(size_t number_of_bytes);
     size_t receiveBufferSize();
     PeerList allPeers();
+    std::shared_ptr<const PeerList> peerSnapshot();
     Peer latestPeer();
     int connectTimeout();
     void setConnectTimeout(int ms);
+    int resolveTimeout();
+    void setResolveTimeout(int ms);
+    void setResolveCache(int ttl_ms, int negative_ttl_ms, size_t max_entries);
+    void invalidateResolveCache(const std::string &host = "");
+    void setFastOpen(int queue_length);
     void setSleepTime(int ms);
-    void onStartedListening(std::function<void(uint16_t)> callback);
-    void onStoppedListening(std::function<void()> callback);
-    void onAccept(std::function<void(Peer pr)> callback);
-    void onReceive(std::function<void(Peer pr, std::vector<uint8_t>bytes)> callback);
-    void onDisconnect(std::function<void(Peer pr)> callback);
-    void onClosedConnection(std::function<void(Peer pr)> callback);
-    void onConnect(std::function<void(Peer pr)> callback);
-    void onSend(std::function<void(Peer pr, size_t amount)> callback);
-    void onListenError(std::function<void (Message msg)> callback);
-    void onSendError(std::function<void (Message msg)> callback);
-    void onConnectError(std::function<void (Message msg)> callback);
-    void onFaultyConnectionClosed(std::function<void(Peer pr, Message err)> callback);
+    void setBusyPoll(uint32_t spin_us);
+    void setCallbackWorkers(size_t worker_count);
+    bool setThreadOptions(NodeThread thread, const ThreadOptions &options);
+    void poll(int timeout_ms);
+    int pollDescriptor();
+    int pollTimeout();
+    void processEvents();
+    void onStartedListening(ListenCallback callback);
+    void onStoppedListening(StoppedCallback callback);
+    void onAccept(PeerCallback callback);
+    void onReceive(ReceiveCallback callback);
+    void onDisconnect(PeerCallback callback);
+    void onClosedConnection(PeerCallback callback);
+    void onConnect(PeerCallback callback);
+    void onSend(SentCallback callback);
+    void onWritable(PeerCallback callback);
+    void onReconnect(PeerCallback callback);
+    void onListenError(ErrorCallback callback);
+    void onSendError(ErrorCallback callback);
+    void onConnectError(ErrorCallback callback);
+    void onFaultyConnectionClosed(PeerErrorCallback callback);
     void setListener(ISocket *ifsock);
     void setSocketInterfaceCreateFunction(std::function<ISocket*()> new_socket_func);
 
 
 protected:
 
+    /**
+     * A single queued message. It either holds
+     * the data itself or a region of an open file
+     * which is streamed with ISocket::sendFile().
+     * The file descriptor is owned by the OutBuffer
+     * and closed when the OutBuffer is destroyed.
+     * data_offset is where the next write of data
+     * starts after a partial write.
+     * completion is optional and called when the
+     * OutBuffer has been sent or dropped.
+    */
+    struct OutBuffer
+    {
+        OutBuffer() = default;
+        OutBuffer(const OutBuffer &other) = delete;
+        OutBuffer(OutBuffer &&other);
+        ~OutBuffer();
+
+        OutBuffer& operator=(const OutBuffer &other) = delete;
+        OutBuffer& operator=(OutBuffer &&other);
+
+        std::vector<uint8_t> data;
+        size_t data_offset = 0;
+        int file_fd = -1;
+        uint64_t file_offset = 0;
+        uint64_t file_remaining = 0;
+        SendCompletion completion;
+    };
+
+    /**
+     * A completion that is due. Completions are
+     * collected while data_access is locked and
+     * called after it was unlocked, so they may
+     * send again right away.
+    */
+    struct FinishedSend
+    {
+        Peer pr;
+        SendCompletion completion;
+        bool success;
+    };
+
+    /**
+     * All messages that are queued for one Peer,
+     * one FIFO per Priority class.
+     * A message that was partially written is 
+     * finished before any other message is started
+     * (in_flight holds its class until then).
+     * starved counts for each class how many
+     * messages of higher classes were sent while
+     * it was waiting.
+     * queued_bytes only counts data held in memory.
+     * File regions are not counted since they stay
+     * on disk until they are sent. send_state is
+     * shared with the Peer, releaseBytes() takes
+     * bytes that were written or dropped off both.
+     * waiting_for_writable is set while the socket
+     * of the Peer does not accept more data.
+     * waiting_fd is the socket number that is
+     * watched by sendPoller in that case (or -1
+     * if it could not be watched).
+     * If coalescing is enabled for the Peer,
+     * nothing is written before hold_until unless
+     * hold_bytes are queued or flush_requested is
+     * set. The socket is corked while writing.
+    */
+    struct OutBufferQueue
+    {
+        static constexpr size_t CLASS_COUNT = 3;
+        static constexpr size_t NO_CLASS = CLASS_COUNT;
+
+        bool empty() const;
+
+        /**
+         * Picks the class whose front message 
+         * is sent next: the message in flight, 
+         * else a class that starved for too long,
+         * else the highest class with messages.
+        */
+        size_t nextClass() const;
+
+        /**
+         * Removes the front message of a class
+         * after it was sent completely.
+        */
+        void popFront(size_t cls);
+
+        void releaseBytes(size_t bytes);
+
+        std::deque<OutBuffer> buffers[CLASS_COUNT];
+        size_t starved[CLASS_COUNT] = {0, 0, 0};
+        size_t in_flight = NO_CLASS;
+        size_t queued_bytes = 0;
+        std::shared_ptr<SendState> send_state;
+        bool waiting_for_writable = false;
+        int32_t waiting_fd = -1;
+        bool coalescing = false;
+        bool flush_requested = false;
+        std::chrono::steady_clock::time_point hold_until;
+        size_t hold_bytes = 0;
+    };
+
+    /**
+     * Coalescing settings of a Peer
+     * (see setCoalescing()).
+    */
+    struct Coalescing
+    {
+        uint32_t window_us;
+        size_t max_bytes;
+    };
+
+    using OutBufferList = std::unordered_map<uint64_t, OutBufferQueue>;
+
+    /**
+     * The callbacks set by the on*() functions.
+     * A published table is never changed, so
+     * events read it without locking.
+    */
+    struct Callbacks
+    {
+        PeerCallback newPeerConnected;
+        PeerCallback connectedToNewPeer;
+        ReceiveCallback received;
+        SentCallback sent;
+        PeerCallback writable;
+        PeerCallback reconnected;
+        PeerCallback peerDisconnected;
+        PeerCallback closedConnection;
+        ListenCallback startedListening;
+        StoppedCallback stoppedListening;
+        ErrorCallback listenError;
+        ErrorCallback sendError;
+        ErrorCallback connectError;
+        PeerErrorCallback faultyConnectionClosed;
+    };
+
+    /**
+     * The passes of node threads that read
+     * the callback table (see CallbackReadScope).
+     * poll() runs all of them in turn.
+    */
+    enum CallbackReader 
+    {
+        LISTEN_READER, 
+        CONNECT_READER, 
+        SEND_READER, 
+        CALLBACK_READERS
+    };
+
+    /**
+     * A replaced callback table. Events that
+     * started in epoch or later cannot see it.
+    */
+    struct RetiredCallbacks
+    {
+        uint64_t epoch;
+        std::unique_ptr<const Callbacks> table;
+    };
+
+    /**
+     * Announces that a pass of a node thread may
+     * read the callback table until the scope ends.
+     * Costs two stores per pass instead of any
+     * work per event.
+    */
+    class CallbackReadScope
+    {
+    public:
+        CallbackReadScope(TcpNodePrivate &node, CallbackReader reader);
+        ~CallbackReadScope();
+
+    private:
+        std::atomic<uint64_t> &m_slot;
+    };
+
+    /**
+     * A message passed to sendData() or sendFile()
+     * on its way to sendThread. Producers push it
+     * to submissions without taking data_access.
+     * flush() and setCoalescing() send a FLUSH or
+     * COALESCING submission without a message, so
+     * they take effect in order with the messages
+     * queued before them.
+    */
+    struct Submission
+    {
+        enum Kind {DATA, FLUSH, COALESCING};
+
+        Peer pr;
+        OutBuffer ob;
+        Priority priority;
+        Kind kind;
+        Coalescing coalescing;
+    };
+
+    /**
+     * A request of connectTo(). reconnect is set
+     * if the request was given a policy. peer_id
+     * is the id of the Peer that is reconnected
+     * (or 0 for a new Peer), attempt counts the failed
+     * attempts in a row and due is the time
+     * the request may be started. pooled is set
+     * for requests of pooledPeer(). fast_open_data
+     * is sent with TCP Fast Open by the first
+     * connect attempt. Requests of connectToAll()
+     * carry the id of their batch (0 for none)
+     * and their index in it.
+    */
+    struct ConnectRequest
+    {
+        std::string host;
+        uint16_t port;
+        ReconnectPolicy policy;
+        bool reconnect;
+        uint64_t peer_id;
+        int attempt;
+        std::chrono::steady_clock::time_point due;
+        bool pooled;
+        std::vector<uint8_t> fast_open_data;
+        uint64_t batch_id;
+        size_t batch_index;
+    };
+
+    /**
+     * The results of a connectToAll() call.
+     * remaining counts the endpoints that
+     * are neither connected nor failed.
+    */
+    struct ConnectBatch
+    {
+        std::vector<ConnectResult> results;
+        size_t remaining;
+        std::function<void(std::vector<ConnectResult> results)> completion;
+    };
+
+    /**
+     * A Peer of the connection pool and
+     * when pooledPeer() handed it out last.
+    */
+    struct PooledPeer
+    {
+        uint64_t id;
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+    /**
+     * The pooled connections to one host and
+     * port, and how many are still connecting.
+    */
+    struct PoolEndpoint
+    {
+        std::vector<PooledPeer> peers;
+        size_t connecting = 0;
+    };
+
+    using ConnectRequestDeque = std::deque<ConnectRequest>;
+
+    /**
+     * A connect attempt to one address.
+     * fd is the socket number that is watched
+     * by connectPoller (or -1 if it could not
+     * be watched, then the attempt is checked
+     * after each sleep time).
+    */
+    struct ConnectAttempt
+    {
+        ISocket *socket;
+        std::string address;
+        int32_t fd;
+    };
+
+    /**
+     * A connectTo() request that is in progress.
+     * The addresses of the host are tried in
+     * turns of IPv6 and IPv4 (Happy Eyeballs,
+     * RFC 8305). The next address is tried when
+     * an attempt fails or at next_attempt, while
+     * the earlier attempts keep going. The first
+     * attempt that connects wins, the others
+     * are closed.
+     * error describes the latest failed attempt.
+     * fast_open_tried is set once an attempt used
+     * TCP Fast Open. fast_open_socket is that
+     * attempt while it is alive and fast_open_sent
+     * how much of the data went out with its SYN.
+    */
+    struct PendingConnect
+    {
+        ConnectRequest origin;
+        std::deque<std::string> addresses;
+        std::list<ConnectAttempt> attempts;
+        std::chrono::steady_clock::time_point next_attempt;
+        std::chrono::steady_clock::time_point deadline;
+        Message error;
+        bool fast_open_tried = false;
+        ISocket *fast_open_socket = nullptr;
+        size_t fast_open_sent = 0;
+    };
+
+    using PendingConnectList = std::list<PendingConnect>;
+
+    /**
+     * A host name that is being resolved by
+     * resolver before it can be connected to.
+    */
+    struct PendingResolve
+    {
+        uint64_t id;
+        ConnectRequest origin;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    using PendingResolveList = std::list<PendingResolve>;
+
+    /**
+     * Result of a lookup, handed from a
+     * resolver thread to connectThread.
+    */
+    struct ResolveResult
+    {
+        uint64_t id;
+        std::vector<std::string> addresses;
+        std::string error;
+    };
+
     /**
      * This worker function is executed
      * by connectThread. Its purpose is to
      * wait until the user puts a connect
      * request into the queue potential_peers
      * by using the connectTo() function.
-     * As soon as the queue is not empty
-     * it tries to connect to all the remotes
-     * in the queue and calls onConnect()
-     * for each if successful or 
-     * callbackConnectError() if it fails.
+     * All requests are started right away
+     * and finished as soon as connectPoller
+     * reports their sockets writable, so
+     * one slow remote does not hold up the
+     * others. onConnect() is called for
+     * each successful attempt and
+     * callbackConnectError() for each
+     * that fails or times out.
     */
     void _connectThreadJob(); 
 
+    /**
+     * Starts the connect requests that are due,
+     * finishes lookups and attempts that are done
+     * and fails those whose deadline has passed.
+     * Called by _connectThreadJob() and poll().
+     * @param[in] ready_fds Sockets reported by connectPoller
+     * @return Timeout for connectPoller in milliseconds
+    */
+    int _connectPass(const std::vector<Poller::Event> &ready_fds);
+
+    /**
+     * Adds a connectTo() request to pending
+     * and starts connecting to the first of
+     * its addresses.
+     * @param[in,out] pending Requests in progress
+     * @param[in] origin The request
+     * @param[in] addresses Numeric addresses of its host
+    */
+    void _startConnect(
+        PendingConnectList &pending,
+        const ConnectRequest &origin,
+        const std::vector<std::string> &addresses);
+
+    /**
+     * Puts requests into potential_peers and
+     * starts connectThread and listenThread
+     * if they are not running yet. A batch
+     * with remaining endpoints is registered
+     * under the batch id of the requests.
+    */
+    void _queueConnectRequests(
+        ConnectRequestDeque &&requests,
+        ConnectBatch &&batch = ConnectBatch());
+
+    /**
+     * Records the outcome of a connectToAll()
+     * request and calls the completion of its
+     * batch when it was the last one.
+    */
+    void _finishBatchEntry(
+        const ConnectRequest &origin,
+        bool connected,
+        const Peer &pr,
+        const Message &errmsg);
+
+    /**
+     * Disconnects pooled Peers that were not
+     * handed out for longer than the idle
+     * timeout, keeping the minimum number of
+     * connections per endpoint.
+     * data_access must be locked.
+    */
+    void _evictIdlePooledPeers();
+
+    /**
+     * Forgets a Peer that is being deleted
+     * if it belongs to the connection pool.
+     * data_access must be locked.
+    */
+    void _removeFromPool(uint64_t peer_id);
+
+    /**
+     * Reports a failed request and schedules
+     * the next attempt if its ReconnectPolicy
+     * allows it. Otherwise a reconnecting Peer
+     * is given up and its held data dropped.
+     * @param[in] origin The request
+     * @param[in] errmsg The error to report
+    */
+    void _connectFailed(
+        const ConnectRequest &origin,
+        const Message &errmsg);
+
+    /**
+     * Time to wait before the next attempt
+     * of a request, following its policy.
+    */
+    static std::chrono::milliseconds _reconnectDelay(
+        const ConnectRequest &origin);
+
+    /**
+     * Schedules a reconnect to a Peer that is
+     * being deleted if it was connected with
+     * a ReconnectPolicy and did not get
+     * disconnected on purpose. Its send queue
+     * is held back for the new connection if
+     * the policy wants it replayed.
+     * data_access must be locked.
+     * @param[in] pr The Peer being deleted
+     * @return Was a reconnect scheduled?
+    */
+    bool _scheduleReconnect(const Peer &pr);
+
+    /**
+     * Starts a non-blocking connect to the
+     * next untried address of a request.
+     * @param[in,out] request The request
+     * @return Socket that connected right away
+     *         or nullptr
+    */
+    ISocket* _startNextAttempt(PendingConnect &request);
+
+    /**
+     * Closes all attempts of a request
+     * that are still in progress.
+    */
+    void _cancelAttempts(PendingConnect &request);
+
+    /**
+     * Hands the host name of a request to resolver
+     * and adds it to resolving. The result is put
+     * into resolved and connectPoller is woken up.
+     * @param[in,out] resolving Lookups in progress
+     * @param[in] origin The request
+    */
+    void _startResolve(
+        PendingResolveList &resolving,
+        const ConnectRequest &origin);
+
+    /**
+     * Starts connecting to the hosts of finished
+     * lookups and reports failed lookups as well
+     * as lookups whose deadline has passed.
+     * Results that arrive after their deadline
+     * are ignored.
+     * @param[in,out] resolving Lookups in progress
+     * @param[in,out] pending Attempts in progress
+     * @param[in] results Finished lookups
+     * @return Timeout for connectPoller in milliseconds
+    */
+    int _finishResolves(
+        PendingResolveList &resolving,
+        PendingConnectList &pending,
+        const std::vector<ResolveResult> &results);
+
+    /**
+     * Hands an error Message to the
+     * onConnectError() callback if one is set.
+     * @param[in] errmsg The error to report
+    */
+    void _reportConnectError(const Message &errmsg);
+
+    /**
+     * Checks all attempts in progress whose socket
+     * is in ready_fds (or cannot be watched), starts
+     * further attempts when they are due and fails
+     * requests whose deadline has passed.
+     * @param[in,out] pending Requests in progress
+     * @param[in] ready_fds Sockets reported by connectPoller
+     * @return Timeout for connectPoller in milliseconds
+    */
+    int _finishConnects(
+        PendingConnectList &pending,
+        const std::vector<Poller::Event> &ready_fds);
+
+    /**
+     * Turns a connected socket into a new Peer
+     * and calls onConnect(). If the request
+     * reconnects a Peer, the Peer keeps its
+     * id, gets back its held send queue and
+     * onReconnect() is called instead.
+    */
+    void _completeConnect(
+        ISocket *socket,
+        const ConnectRequest &origin);
+
     /**
      * This worker function is executed
      * by sendThread. Its purpose is to
      * wait until the user puts data 
-     * into the list data_to_send by using the
-     * sendData() function. As soon as the
-     * list is not empty it tries to send
-     * all the data in the list and calls
-     * onSend() for each one if successful 
-     * or callbackSendError() if it fails.
+     * into the queues of data_to_send by
+     * using sendData() or sendFile(). 
+     * Queued data is written right away
+     * for as long as the sockets accept it.
+     * Sockets that are full are watched by
+     * sendPoller until they become writable
+     * again. onSend() is called for every
+     * write and callbackSendError() if
+     * a write fails.
     */
     void _sendThreadJob();
 
+    /**
+     * Writes queued data of all peers
+     * that are not waiting for their
+     * socket to become writable.
+     * Called by _sendThreadJob().
+     * @return How long sendThread may wait for
+     *         sendPoller in milliseconds
+     *         (-1 for no timeout).
+    */
+    int _sendQueuedData();
+
+    /**
+     * Moves everything from submissions into the
+     * send queues and applies flush and coalescing
+     * requests. Messages for Peers that are
+     * gone by now are failed.
+     * Called by _sendThreadJob() while
+     * data_access is locked.
+    */
+    void _takeSubmissions();
+
+    /**
+     * Starts sendThread if it is not running yet.
+     * Only locks send_thread_access the first time,
+     * so it may be called while data_access is held.
+    */
+    void _startSendThreadIfNotRunning();
+
+    /**
+     * Marks the sockets in ready_fds as writable
+     * again, moves submissions into the send queues,
+     * writes what can be written and runs the
+     * completions of finished messages.
+     * Called by _sendThreadJob() and poll().
+     * @param[in] ready_fds Sockets reported by sendPoller
+     * @return Timeout for sendPoller in milliseconds
+    */
+    int _sendPass(const std::vector<Poller::Event> &ready_fds);
+
+    /**
+     * Returns the SendState of a new Peer. A Peer
+     * that is reconnected gets its old one back.
+     * Called while data_access is locked.
+    */
+    std::shared_ptr<SendState> _openSendState(uint64_t peer_id);
+
+    /**
+     * Turns away further sendData() calls for a
+     * Peer that is gone. If it is reconnecting,
+     * its SendState is kept for the new connection
+     * and stays open if its queue is held.
+     * Called while data_access is locked.
+    */
+    void _closeSendState(uint64_t peer_id, bool reconnecting);
+
+    /**
+     * Removes a send queue from data_to_send
+     * and stops watching its socket. Completions
+     * of the dropped messages are marked as failed.
+     * @param[in] itqueue The queue to remove
+     * @param[in] pr The Peer the queue belongs to
+     * @return Iterator to the next queue
+    */
+    OutBufferList::iterator _dropSendQueue(
+        OutBufferList::iterator itqueue,
+        const Peer &pr);
+
+    /**
+     * Marks the completion of a message that
+     * will not be sent (if it has one) as failed.
+    */
+    void _abandonOutBuffer(OutBuffer &ob, const Peer &pr);
+
+    /**
+     * Calls all completions that were collected
+     * in finished_sends. Must be called while
+     * data_access is not locked.
+    */
+    void _runSendCompletions();
+
+    /**
+     * Returns the published callback table.
+     * A single atomic load, no locking. Node
+     * threads read it inside a CallbackReadScope,
+     * other threads while foreign_callback_readers
+     * counts them.
+    */
+    const Callbacks& _callbacks() const;
+
+    /**
+     * Publishes a copy of the callback table
+     * that was changed by change and retires
+     * the old one.
+    */
+    void _setCallback(const std::function<void(Callbacks&)> &change);
+
+    /**
+     * Frees retired callback tables that no pass
+     * and no foreign reader can still be reading.
+     * callback_access must be locked.
+    */
+    void _reclaimCallbacks();
+
+    /**
+     * Runs a Peer callback with args, either right
+     * away or on the worker of the Peer
+     * (see setCallbackWorkers()).
+    */
+    template<typename Callback, typename... Args>
+    void _dispatch(
+        uint64_t peer_id,
+        const Callback &callback,
+        Args&&... args);
+
+    /**
+     * Writes as much of an OutBuffer as the
+     * socket accepts right now. Data that was
+     * sent is removed from the OutBuffer.
+     * @param[in] psocket Socket of the receiving peer
+     * @param[in,out] ob The OutBuffer to write
+     * @param[out] complete Set to true when nothing
+     *             of the OutBuffer is left to send.
+     * @return Number of bytes that were sent
+    */
+    size_t _writeOutBuffer(
+        ISocket *psocket,
+        OutBuffer &ob,
+        bool &complete);
+
     /**
      * This worker function is executed
      * by listenThread. Its purpose
@@ -133,6 +835,64 @@ protected:
     */
     void _listenThreadJob();
 
+    /**
+     * Opens, reopens or closes the listener
+     * as requested by doListen(), stopListening()
+     * and setListener().
+     * Called by _listenThreadJob() and poll().
+    */
+    void _updateListener();
+
+    /**
+     * Accepts a new connection, receives from
+     * all Peers and deletes the next Peer that
+     * is scheduled for deletion.
+     * Called by _listenThreadJob() and poll().
+     * @param[out] had_work Set if a connection was
+     *             accepted, data received or a Peer
+     *             deleted
+     * @return Is another Peer waiting for deletion?
+    */
+    bool _receivePass(bool &had_work);
+
+    /**
+     * pollPoller watches the sockets of the
+     * listener and all Peers, so poll() and
+     * a parked listenThread wake up when one
+     * of them becomes readable.
+     * @param[in] socket Socket to (un)watch
+    */
+    void _watchSocket(ISocket *socket);
+    void _unwatchSocket(ISocket *socket);
+
+    /**
+     * Ends a waiting poll() or a parked
+     * listenThread, so requested work is
+     * done right away.
+    */
+    void _wakeupPoll();
+
+    /**
+     * ThreadOptions of a kind of thread.
+     * data_access must be locked.
+    */
+    ThreadOptions& _threadOptions(NodeThread thread);
+
+    /**
+     * Name of listenThread, connectThread
+     * or sendThread.
+    */
+    static std::string _threadName(NodeThread thread);
+
+    /**
+     * Names listenThread, connectThread or
+     * sendThread and applies its ThreadOptions
+     * if it is running. data_access must be locked.
+     * @return false if the running thread did
+     *         not take all of the options
+    */
+    bool _setupThread(NodeThread thread);
+
     /**
      * listenThread needs to be active as soon
      * as the first peer connects or has been
@@ -156,27 +916,22 @@ protected:
      * The pause will also end if one the following is
      * true: constructor_called, m_wakeup_listen_thread or 
      * m_changing_listener.
+     * With busy polling it spins for up to
+     * busy_poll_us before it waits.
     */
     void _pauseUntilPeersOrListenerAvailable();
 
     /**
-     * If the worker function _connectThreadJob()
-     * notices that the potential_peers dequeue is empty
-     * it calls this function to pause until
-     * at least one element apperas in potential_peers.
-     * The pause will also end if constructor_called is true.
-    */
-    void _pauseUntilQueueNotEmpty();
-
-    /**
-     * If the worker function _sendThreadJob()
-     * notices that the data_so_send list is empty
-     * it calls this function to pause until
-     * at least on element appears in data_to_send.
-     * The pause will also end if constructor_called is true.
+     * Waits until sendThread has something to do:
+     * a submission, a socket of sendPoller or a
+     * wakeup. With busy polling it spins for up to
+     * busy_poll_us before it blocks in sendPoller.
+     * @param[out] events Ready sockets of sendPoller
+     * @param[in] timeout_ms Longest wait, -1 for none
     */
-    void _pauseUntilDataToSendAvailable();
-
+    void _waitForSendWork(
+        std::vector<Poller::Event> &events, 
+        int timeout_ms);
 
     /**
      * Creates a Message with the desired
@@ -195,32 +950,115 @@ protected:
         const std::string &b,
         ISocket *sock = nullptr);
 
+    /**
+     * Same as above for an error number that
+     * was already taken from the ISocket with
+     * getLastErrno(), which clears it.
+     * @param[in] h Head of Message
+     * @param[in] b Body of Message
+     * @param[in] errornum Error number, 0 for none
+    */
+    Message _createErrorMessage(
+        const std::string &h,
+        const std::string &b,
+        int errornum);
+
+    /**
+     * Schedules a Peer for deletion by the
+     * listen thread. errmsg is kept for
+     * onDisconnect callbacks if it is set.
+    */
+    void _schedulePeerDelete(
+        uint64_t peer_id,
+        DisconnectType dt,
+        const Message &errmsg = Message());
+
     /**
      * Check wether a Peer is in
-     * the peers unordered map.
+     * the peers table.
      * @param[in] The Peer to be checked
      * @return Is the Peer in the vector?
     */
     bool _peerExists(uint64_t peer_id);
 
+    /**
+     * Hands an error Message to the
+     * onSendError() callback if one is set.
+     * @param[in] errmsg The error to report
+    */
+    void _reportSendError(const Message &errmsg);
+
+    /**
+     * Hands an error to the onSendError() callback
+     * and tells the completion of the OutBuffer
+     * (if any) that it will not be sent.
+     * @param[in] pr Receiver of the OutBuffer
+     * @param[in] ob The OutBuffer that is not sent
+     * @param[in] errmsg The error to report
+    */
+    void _failSend(
+        const Peer &pr,
+        OutBuffer &ob,
+        const Message &errmsg);
+
+    /**
+     * Puts a region of an already opened file
+     * into the send queue of a Peer.
+     * @param[in] pr Receiver of the file
+     * @param[in] ob OutBuffer that owns the
+     *               descriptor of the file
+     * @param[in] offset First byte to send
+     * @param[in] length Number of bytes to send
+     *                   (0 means until end of file)
+     * @param[in] priority Priority class of the file
+     * @param[in] name File name used in error messages
+    */
+    bool _queueFile(
+        const Peer &pr,
+        OutBuffer &&ob,
+        uint64_t offset,
+        uint64_t length,
+        Priority priority,
+        const std::string &name);
+
+    /**
+     * Appends an OutBuffer to the send queue
+     * of a Peer and wakes up sendThread.
+     * In-memory data that is not URGENT is
+     * rejected while the queue holds more
+     * than the high watermark.
+     * @param[in] pr Receiver of the OutBuffer
+     * @param[in] ob The OutBuffer to queue
+     * @param[in] priority Priority class of the OutBuffer
+     * @return Was the OutBuffer queued?
+    */
+    bool _queueOutBuffer(
+        const Peer &pr,
+        OutBuffer &&ob,
+        Priority priority);
+
     static ISocket* defaultNewSocket();
 
 
 private:
 
     const int DEFAULT_TIMEOUT_MS = 3000;
+    const int DEFAULT_RESOLVE_TIMEOUT_MS = 5000;
+    const int CONNECTION_ATTEMPT_DELAY_MS = 250;
     const int DEFAULT_SLEEPTIME_MS = 10;
+    const uint64_t FILE_CHUNK_SIZE = 1048576;
+    const size_t UNLIMITED_WATERMARK = static_cast<size_t>(-1);
+    const uint64_t SEND_BUDGET_PER_PASS = 1048576;
+    static const size_t STARVATION_LIMIT = 16;
+    static const size_t NODE_THREAD_KINDS = 5;
 
     using Lock = std::unique_lock<std::mutex>;
     using Condition = std::condition_variable;
-    using IpAndPort = std::pair<std::string, uint16_t>;
-    using IpAndPortDeque = std::deque<IpAndPort>;
     using PeerSocketList = std::unordered_map<uint64_t, ISocket*>;
-    using OutBuffer = std::pair<uint64_t, std::vector<uint8_t>>;
-    using OutBufferList = std::list<OutBuffer>;
 
     ISocket *m_listener;
 
+    const RunMode m_run_mode;
     std::atomic<uint16_t> m_portnumber;
     IpVersion m_ip_version;
     std::atomic<bool> m_connect_thread_running;
@@ -234,28 +1072,38 @@ private:
 
     //Timeouts
     std::atomic_int m_connect_timeout;
+    std::atomic_int m_resolve_timeout;
     std::atomic_int m_sleep_time;
 
-    IpAndPortDeque m_potential_peers;
+    //Spin budget of busy polling, 0 disables it
+    std::atomic<uint32_t> m_busy_poll_us{0};
+
+    //Queue length for TCP Fast Open of the listener
+    std::atomic_int m_fast_open_queue;
+
+    //Send queue limits per peer
+    std::atomic<size_t> m_send_low_watermark;
+    std::atomic<size_t> m_send_high_watermark;
+
+    ConnectRequestDeque m_potential_peers;
     OutBufferList m_data_to_send;
 
     std::thread m_connectThread;
     std::thread m_sendThread;
     std::thread m_listenThread;
+    ThreadOptions m_thread_options[NODE_THREAD_KINDS];
 
     //Callbacks
-    std::function<void(Peer pr)> m_callbackNewPeerConnected;
-    std::function<void(Peer pr)> m_callbackConnectedToNewPeer;
-    std::function<void(Peer pr, std::vector<uint8_t> bytes)> m_callbackReceived;
-    std::function<void(Peer pr, size_t amount)> m_callbackSent;
-    std::function<void(Peer pr)> m_callbackPeerDisconnected;
-    std::function<void(Peer pr)> m_callbackClosedConnection;
-    std::function<void(uint16_t listen_port)> m_callbackStartedListening;
-    std::function<void()> m_callbackStoppedListening;
-    std::function<void(Message err)> m_callbackListenError;
-    std::function<void(Message err)> m_callbackSendError;
-    std::function<void(Message err)> m_callbackConnectError;
-    std::function<void(Peer pr, Message err)> m_callbackFaultyConnectionClosed;
+    //Published table of callbacks and the tables it
+    //replaced, see _setCallback(). epoch counts the
+    //replacements, callback_readers holds the epoch
+    //each running pass started in (0 when idle).
+    std::atomic<const Callbacks*> m_callbacks;
+    std::atomic<uint64_t> m_callback_epoch{1};
+    std::atomic<uint64_t> m_callback_readers[CALLBACK_READERS];
+    std::atomic<int> m_foreign_callback_readers{0};
+    std::vector<RetiredCallbacks> m_retired_callbacks;
+    std::shared_ptr<Dispatcher> m_dispatcher;
 
     //ISocket creator
     std::function<ISocket*()> m_createNewSocketFunction;
@@ -263,14 +1111,46 @@ private:
     //Mutexes and condition variables
     std::mutex m_data_access;
     std::mutex m_callback_access;
+    std::mutex m_send_thread_access;
     Condition m_peers_or_listener_available;
-    Condition m_queue_not_empty;
-    Condition m_data_to_send_available;
+    Poller m_connect_poller;
+    ConnectRequestDeque m_connect_waiting;
+    PendingResolveList m_resolving;
+    PendingConnectList m_pending_connects;
+    std::vector<ResolveResult> m_resolved;
+    uint64_t m_resolve_counter = 0;
+    Poller m_send_poller;
+    std::unordered_map<int32_t, uint64_t> m_send_waiting;
+    std::vector<FinishedSend> m_finished_sends;
+    MpscQueue<Submission> m_submissions;
+    std::atomic<bool> m_send_thread_idle{false};
+
+    //pollPoller watches all sockets for listenThread
+    //and poll(). RunMode::POLL also watches connectPoller
+    //and sendPoller with it. poll_due is the timeout
+    //the last poll() asked for.
+    Poller m_poll_poller;
+    int m_poll_due = 0;
+    std::unordered_map<uint64_t, std::shared_ptr<SendState>> m_send_states;
+    std::unordered_map<uint64_t, Coalescing> m_coalescing;
+    std::unordered_map<uint64_t, ConnectRequest> m_persistent_peers;
+    OutBufferList m_held_queues;
+    std::unordered_map<std::string, PoolEndpoint> m_pool;
+    std::unordered_map<uint64_t, std::string> m_pooled_peer_keys;
+    size_t m_pool_min = 0;
+    size_t m_pool_max = 1;
+    int m_pool_idle_timeout = 60000;
+    std::unordered_map<uint64_t, ConnectBatch> m_connect_batches;
+    std::atomic<uint64_t> m_batch_counter{0};
 
-    PeerList m_peers;
+    PeerTable m_peers;
 
     static std::atomic<uint64_t> m_connection_counter;
 
+    //Declared last so its workers are gone
+    //before anything they report to.
+    Resolver m_resolver;
+
 };
 
 }
@@ -0,0 +1,153 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include "ThreadSetup.hpp"
+
+#ifdef __linux__
+
+#include <pthread.h>
+#include <sched.h>
+
+#elif defined _WIN32
+
+#include <windows.h>
+
+#endif
+
+namespace spw
+{
+
+#ifdef __linux__
+
+using ThreadHandle = pthread_t;
+
+static ThreadHandle currentThread()
+{
+    return pthread_self();
+}
+
+static bool setupHandle(
+    ThreadHandle handle,
+    const std::string &name,
+    const ThreadOptions &options)
+{
+    bool applied =
+        pthread_setname_np(handle, name.substr(0, 15).c_str()) == 0;
+
+    if(!options.cpus.empty())
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for(int cpu : options.cpus)
+        {
+            if(cpu >= 0 && cpu < CPU_SETSIZE)
+            {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        applied = pthread_setaffinity_np(
+            handle, sizeof(cpus), &cpus) == 0 && applied;
+    }
+
+    if(options.fifo_priority > 0)
+    {
+        sched_param param;
+        param.sched_priority = options.fifo_priority;
+        applied = pthread_setschedparam(
+            handle, SCHED_FIFO, &param) == 0 && applied;
+    }
+
+    return applied;
+}
+
+#elif _WIN32
+
+using ThreadHandle = HANDLE;
+
+static ThreadHandle currentThread()
+{
+    return GetCurrentThread();
+}
+
+//Windows has no SCHED_FIFO. Time critical
+//priority comes closest to it. Thread names
+//need SetThreadDescription() which older
+//MinGW versions lack, so they are skipped.
+static bool setupHandle(
+    ThreadHandle handle,
+    const std::string &name,
+    const ThreadOptions &options)
+{
+    (void)name;
+    bool applied = true;
+
+    if(!options.cpus.empty())
+    {
+        DWORD_PTR mask = 0;
+        for(int cpu : options.cpus)
+        {
+            if(cpu >= 0 && cpu < static_cast<int>(sizeof(mask) * 8))
+            {
+                mask |= static_cast<DWORD_PTR>(1) << cpu;
+            }
+        }
+        applied = SetThreadAffinityMask(handle, mask) != 0;
+    }
+
+    if(options.fifo_priority > 0)
+    {
+        applied = SetThreadPriority(
+            handle, THREAD_PRIORITY_TIME_CRITICAL) != 0 && applied;
+    }
+
+    return applied;
+}
+
+#endif
+
+bool setupThread(
+    std::thread &thread,
+    const std::string &name,
+    const ThreadOptions &options)
+{
+    if(!thread.joinable())
+    {
+        return false;
+    }
+
+    return setupHandle(
+        static_cast<ThreadHandle>(thread.native_handle()), name, options);
+}
+
+std::thread startThread(
+    const std::string &name,
+    const ThreadOptions &options,
+    std::function<void()> job)
+{
+    return std::thread([name, options, job](){
+        setupHandle(currentThread(), name, options);
+        job();
+    });
+}
+
+}
@@ -0,0 +1,67 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef SPW_THREAD_SETUP_HPP_
+#define SPW_THREAD_SETUP_HPP_
+
+#include <functional>
+#include <string>
+#include <thread>
+#include "../include/common.hpp"
+
+namespace spw
+{
+
+/**
+ * Names a thread and applies ThreadOptions to it.
+ * Names are cut to the 15 characters Linux allows.
+ * What cannot be applied, like SCHED_FIFO without
+ * the permission for it, is left as it was.
+ * @param[in] thread A running thread
+ * @param[in] name Name shown by top, perf, gdb ...
+ * @param[in] options CPUs and priority of the thread
+ * @return Could everything be applied?
+*/
+bool setupThread(
+    std::thread &thread,
+    const std::string &name,
+    const ThreadOptions &options);
+
+/**
+ * Starts a thread that names itself and applies
+ * options before it runs job, so it never runs
+ * unnamed or on other CPUs. What cannot be applied
+ * is left as it was, like by setupThread().
+ * @param[in] name Name shown by top, perf, gdb ...
+ * @param[in] options CPUs and priority of the thread
+ * @param[in] job What the thread runs
+ * @return The started thread
+*/
+std::thread startThread(
+    const std::string &name,
+    const ThreadOptions &options,
+    std::function<void()> job);
+
+}
+
+#endif //SPW_THREAD_SETUP_HPP_
@@ -36,6 +36,10 @@ class MockSocket : public spw::ISocket
     MOCK_METHOD1(
       send, 
       size_t(const std::vector<uint8_t> &dataToSend));
+    MOCK_METHOD3(
+      sendFile,
+      size_t(int fileDescriptor, uint64_t offset, size_t length));
+    MOCK_METHOD1(setCorked, bool(bool corked));
     MOCK_METHOD0(socketNumber, int32_t());
     MOCK_METHOD0(isListener, bool());
     MOCK_METHOD0(listenPort, uint16_t());
@@ -27,6 +27,9 @@ SOFTWARE.
 #include "tst_gtest.hpp"
 #include "tst_socket.hpp"
 #include "tst_tcpnode.hpp"
+#include "tst_delegate.hpp"
+#include "tst_mpscqueue.hpp"
+#include "tst_resolver.hpp"
 
 
 int main(int argc, char **argv)
@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "gtest/gtest.h"
+#include "../include/Peer.hpp"
+#include <functional>
+#include <vector>
+
+using namespace testing;
+
+TEST(delegate, passesArgumentsWithoutCopying)
+{
+    std::vector<uint8_t> bytes(1000, 7);
+    const uint8_t *data = bytes.data();
+    const uint8_t *received = nullptr;
+    spw::Peer peer;
+
+    spw::ReceiveCallback by_reference =
+        [&received](const spw::Peer&, std::vector<uint8_t> &&dat){
+            received = dat.data();
+    };
+    spw::ReceiveCallback by_value =
+        [&received](spw::Peer, std::vector<uint8_t> dat){
+            received = dat.data();
+    };
+
+    ASSERT_TRUE(static_cast<bool>(by_reference));
+    by_reference(peer, std::move(bytes));
+    ASSERT_EQ(received, data);
+    ASSERT_EQ(bytes.size(), 1000u);
+
+    by_value(peer, std::move(bytes));
+    ASSERT_EQ(received, data);
+    ASSERT_TRUE(bytes.empty());
+
+    spw::ReceiveCallback copy = by_reference;
+    by_reference = nullptr;
+    ASSERT_FALSE(static_cast<bool>(by_reference));
+    ASSERT_TRUE(static_cast<bool>(copy));
+}
+
+TEST(delegate, staysEmptyForEmptyCallables)
+{
+    std::function<void(int)> empty_function;
+    void (*null_function)(int) = nullptr;
+    int calls = 0;
+
+    spw::Delegate<void(int)> from_function(empty_function);
+    spw::Delegate<void(int)> from_pointer(null_function);
+    spw::Delegate<void(int)> from_lambda([&calls](int){ ++calls; });
+
+    ASSERT_FALSE(from_function);
+    ASSERT_FALSE(from_pointer);
+    ASSERT_TRUE(from_lambda);
+
+    from_lambda(1);
+    ASSERT_EQ(calls, 1);
+}
@@ -0,0 +1,68 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "gtest/gtest.h"
+#include "../src/MpscQueue.hpp"
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace testing;
+
+TEST(mpscQueue, keepsOrderOfEachProducer)
+{
+    spw::MpscQueue<std::pair<int, int>> queue;
+    std::vector<std::thread> producers;
+    const int producer_count = 4;
+    const int per_producer = 10000;
+
+    for(int p = 0; p < producer_count; ++p)
+    {
+        producers.emplace_back([&queue, p, per_producer](){
+            for(int i = 0; i < per_producer; ++i)
+            {
+                queue.push(std::make_pair(p, i));
+            }
+        });
+    }
+
+    std::vector<int> next(producer_count, 0);
+    int taken = 0;
+    std::pair<int, int> item;
+
+    while(taken < producer_count * per_producer)
+    {
+        if(queue.pop(item))
+        {
+            ASSERT_EQ(item.second, next[item.first]);
+            ++next[item.first];
+            ++taken;
+        }
+    }
+
+    for(auto &producer : producers)
+    {
+        producer.join();
+    }
+
+    ASSERT_TRUE(queue.empty());
+}
@@ -0,0 +1,62 @@
+/*
+Copyright (c) 2019 Ivan Brebric
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software
+is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "gtest/gtest.h"
+#include "../src/Resolver.hpp"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+
+using namespace testing;
+
+TEST(resolver, canCacheResults)
+{
+    spw::Resolver resolver;
+    std::atomic<int> results(0);
+    std::atomic<bool> answered_from_cache(false);
+    std::thread::id caller = std::this_thread::get_id();
+
+    //Cached results are handed out right away
+    //on the thread that called resolve().
+    auto callback = [&](std::vector<std::string> addresses, std::string error){
+        answered_from_cache = std::this_thread::get_id() == caller;
+        ++results;
+    };
+
+    resolver.resolve("localhost", TEST_PORT, callback);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(results, 1);
+    ASSERT_FALSE(answered_from_cache);
+
+    //Answered from the cache before resolve() returns.
+    resolver.resolve("localhost", TEST_PORT, callback);
+    ASSERT_EQ(results, 2);
+    ASSERT_TRUE(answered_from_cache);
+
+    resolver.invalidate("localhost");
+    resolver.resolve("localhost", TEST_PORT, callback);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(results, 3);
+    ASSERT_FALSE(answered_from_cache);
+}
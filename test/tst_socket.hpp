@@ -23,6 +23,7 @@ SOFTWARE.
 #include "gtest/gtest.h"
 #include "../src/Socket.hpp"
 #include <iostream>
+#include <cstdio>
 
 using namespace testing;
 
@@ -221,3 +222,69 @@ TEST(socket, canShowIpAndPortIpV4)
   std::cout << "#### CLIENT PORT: " << client_port << std::endl;
   std::cout << "#### PEER NAME: " << peer_name << std::endl;
 }
+
+TEST(socket, canSendFile)
+{
+  spw::Socket server;
+  spw::Socket client;
+  spw::Socket *peer = nullptr;
+
+  std::vector<uint8_t> recv_data;
+  std::vector<uint8_t> expected_data(test_data.begin() + 1, test_data.end());
+
+  FILE *file = std::tmpfile();
+  ASSERT_TRUE(file != nullptr);
+  std::fwrite(test_data.data(), 1, test_data.size(), file);
+  std::fflush(file);
+
+  server.listen(TEST_PORT, spw::IpVersion::IPV4);
+  client.connect("127.0.0.1", TEST_PORT);
+  peer = dynamic_cast<spw::Socket*>(server.accept());
+
+  ASSERT_TRUE(peer != nullptr);
+  ASSERT_EQ(peer->sendFile(fileno(file), 1, expected_data.size()),
+            expected_data.size());
+
+  ASSERT_EQ(client.receive(recv_data), spw::Socket::ReceiveResult::OK);
+  ASSERT_EQ(expected_data, recv_data);
+
+  std::fclose(file);
+  delete peer;
+}
+
+TEST(socket, canConnectWithoutBlocking)
+{
+  spw::Socket server;
+  spw::Socket client;
+
+  server.listen(TEST_PORT, spw::IpVersion::IPV4);
+
+  ASSERT_TRUE(client.startConnect("127.0.0.1", TEST_PORT));
+
+  for(int i = 0; i < 100 && !client.finishConnect(); ++i)
+  {
+    ASSERT_EQ(client.getLastErrno(), 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  spw::ISocket *peer = server.accept();
+
+  ASSERT_TRUE(client.isConnected());
+  ASSERT_TRUE(peer != nullptr);
+
+  client.close();
+  peer->close();
+  server.close();
+  delete peer;
+}
+
+TEST(socket, canClearErrorOnRead)
+{
+  spw::Socket client;
+
+  //Nothing listens at TEST_PORT.
+  ASSERT_FALSE(client.connect("127.0.0.1", TEST_PORT));
+
+  ASSERT_NE(client.getLastErrno(), 0);
+  ASSERT_EQ(client.getLastErrno(), 0);
+}
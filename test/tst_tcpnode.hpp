@@ -26,6 +26,15 @@ SOFTWARE.
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <cstdio>
+#include <set>
+#include <memory>
+#include <mutex>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#endif
 
 using namespace testing;
 using ::testing::_;
@@ -322,4 +331,1344 @@ TEST(tcpNodePrivate, canSend)
     ASSERT_TRUE(cb_send_called);
 }
 
+TEST(tcpNodePrivate, canSendFile)
+{
+    //Declared before the node so the mock outlives it
+    //and its expectations are verified when it is deleted.
+    std::unique_ptr<MockSocket> mock_owner(new MockSocket());
+    MockSocket *mock_sock = mock_owner.get();
+    spw::TcpNodePrivate node;
+
+    std::string test_ip("192.168.1.10");
+    uint16_t test_port(4200);
+    std::string test_name("test");
+    std::vector<uint8_t> test_data = {'h', 'e', 'l', 'l', 'o'};
+    std::atomic<size_t> amount_sent(0);
+
+    FILE *file = std::tmpfile();
+    ASSERT_TRUE(file != nullptr);
+    std::fwrite(test_data.data(), 1, test_data.size(), file);
+    std::fflush(file);
+
+    auto socketCreator = [&]() -> spw::ISocket* {
+         return mock_sock;
+    };
+
+    node.setSocketInterfaceCreateFunction(socketCreator);
+    node.onSend([&](spw::Peer pr, size_t amount){
+        amount_sent += amount;
+    }); 
+
+    EXPECT_CALL(*mock_sock, connect(test_ip, test_port))
+        .Times(AtLeast(1))
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*mock_sock, isConnected())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*mock_sock, peerIpAddress())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_ip));
+
+    EXPECT_CALL(*mock_sock, peerPort())
+         .Times(AtLeast(1))
+         .WillRepeatedly(Return(test_port));
+
+    EXPECT_CALL(*mock_sock, peerName())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_name));
+
+    EXPECT_CALL(*mock_sock, sendFile(_, 1, test_data.size() - 1))
+        .Times(1)
+        .WillOnce(Return(test_data.size() - 1));
+
+    node.connectTo(test_ip, test_port);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    node.sendFile(node.latestPeer(), fileno(file), 1);
+    std::fclose(file);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    ASSERT_EQ(amount_sent, test_data.size() - 1);
+}
+
+TEST(tcpNodePrivate, canLimitSendQueue)
+{
+    //Declared before the node so the mock outlives it
+    //and its expectations are verified when it is deleted.
+    std::unique_ptr<MockSocket> mock_owner(new MockSocket());
+    MockSocket *mock_sock = mock_owner.get();
+    spw::TcpNodePrivate node;
+
+    std::string test_ip("192.168.1.10");
+    uint16_t test_port(4200);
+    std::string test_name("test");
+    std::vector<uint8_t> test_data = {'h', 'e', 'l', 'l', 'o'};
+
+    std::atomic<bool> socket_writable(false);
+    std::atomic<bool> cb_send_error_called(false);
+    std::atomic<bool> cb_writable_called(false);
+
+    auto socketCreator = [&]() -> spw::ISocket* {
+         return mock_sock;
+    };
+
+    node.setSocketInterfaceCreateFunction(socketCreator);
+    node.setSendWatermarks(0, test_data.size());
+    node.onSendError([&](spw::Message){
+        cb_send_error_called = true;
+    });
+    node.onWritable([&](spw::Peer pr){
+        cb_writable_called = true;
+    });
+
+    EXPECT_CALL(*mock_sock, connect(test_ip, test_port))
+        .Times(AtLeast(1))
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*mock_sock, isConnected())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*mock_sock, peerIpAddress())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_ip));
+
+    EXPECT_CALL(*mock_sock, peerPort())
+         .Times(AtLeast(1))
+         .WillRepeatedly(Return(test_port));
+
+    EXPECT_CALL(*mock_sock, peerName())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_name));
+
+    //The mock has no real socket that
+    //could be watched for writability.
+    EXPECT_CALL(*mock_sock, socketNumber())
+        .WillRepeatedly(Return(-1));
+
+    //Nothing is accepted by the socket
+    //until socket_writable is set.
+    EXPECT_CALL(*mock_sock, send(_))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Invoke([&](const std::vector<uint8_t> &dat) {
+            return socket_writable ? dat.size() : 0;
+        }));
+
+    node.connectTo(test_ip, test_port);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    spw::Peer pr = node.latestPeer();
+
+    ASSERT_TRUE(node.sendData(pr, test_data));
+    ASSERT_EQ(node.queuedBytes(pr), test_data.size());
+    ASSERT_FALSE(node.sendData(pr, test_data));
+    ASSERT_TRUE(cb_send_error_called);
+    ASSERT_FALSE(cb_writable_called);
+
+    socket_writable = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    ASSERT_TRUE(cb_writable_called);
+    ASSERT_EQ(node.queuedBytes(pr), 0);
+    ASSERT_TRUE(node.sendData(pr, test_data));
+}
+
+TEST(tcpNodePrivate, canSendWithoutDelay)
+{
+    //Declared before the node so the mock outlives it
+    //and its expectations are verified when it is deleted.
+    std::unique_ptr<MockSocket> mock_owner(new MockSocket());
+    MockSocket *mock_sock = mock_owner.get();
+    spw::TcpNodePrivate node;
+
+    std::string test_ip("192.168.1.10");
+    uint16_t test_port(4200);
+    std::string test_name("test");
+    std::vector<uint8_t> test_data = {'h', 'e', 'l', 'l', 'o'};
+    const size_t message_count = 1000;
+    std::atomic<size_t> send_count(0);
+
+    auto socketCreator = [&]() -> spw::ISocket* {
+         return mock_sock;
+    };
+
+    node.setSocketInterfaceCreateFunction(socketCreator);
+    node.onSend([&](spw::Peer pr, size_t amount){
+        ++send_count;
+    }); 
+
+    EXPECT_CALL(*mock_sock, connect(test_ip, test_port))
+        .Times(AtLeast(1))
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*mock_sock, isConnected())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*mock_sock, peerIpAddress())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_ip));
+
+    EXPECT_CALL(*mock_sock, peerPort())
+         .Times(AtLeast(1))
+         .WillRepeatedly(Return(test_port));
+
+    EXPECT_CALL(*mock_sock, peerName())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_name));
+
+    EXPECT_CALL(*mock_sock, send(_))
+        .Times(message_count)
+        .WillRepeatedly(Return(test_data.size()));
+
+    node.connectTo(test_ip, test_port);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    spw::Peer pr = node.latestPeer();
+
+    for(size_t i = 0; i < message_count; ++i)
+    {
+        node.sendData(pr, test_data);
+    }
+
+    //One sleep time per message would take 10 seconds.
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    ASSERT_EQ(send_count, message_count);
+}
+
+TEST(tcpNodePrivate, canSendByPriority)
+{
+    //Declared before the node so the mock outlives it
+    //and its expectations are verified when it is deleted.
+    std::unique_ptr<MockSocket> mock_owner(new MockSocket());
+    MockSocket *mock_sock = mock_owner.get();
+    spw::TcpNodePrivate node;
+
+    std::string test_ip("192.168.1.10");
+    uint16_t test_port(4200);
+    std::string test_name("test");
+
+    std::atomic<bool> socket_writable(false);
+    std::mutex send_order_access;
+    std::vector<uint8_t> send_order;
+
+    auto socketCreator = [&]() -> spw::ISocket* {
+         return mock_sock;
+    };
+
+    node.setSocketInterfaceCreateFunction(socketCreator);
+
+    EXPECT_CALL(*mock_sock, connect(test_ip, test_port))
+        .Times(AtLeast(1))
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*mock_sock, isConnected())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*mock_sock, peerIpAddress())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_ip));
+
+    EXPECT_CALL(*mock_sock, peerPort())
+         .Times(AtLeast(1))
+         .WillRepeatedly(Return(test_port));
+
+    EXPECT_CALL(*mock_sock, peerName())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_name));
+
+    EXPECT_CALL(*mock_sock, socketNumber())
+        .WillRepeatedly(Return(-1));
+
+    EXPECT_CALL(*mock_sock, send(_))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Invoke([&](const std::vector<uint8_t> &dat) {
+            if(!socket_writable)
+            {
+                return static_cast<size_t>(0);
+            }
+            std::lock_guard<std::mutex> lck(send_order_access);
+            send_order.push_back(dat.front());
+            return dat.size();
+        }));
+
+    node.connectTo(test_ip, test_port);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    spw::Peer pr = node.latestPeer();
+
+    node.sendData(pr, {'b'}, spw::Priority::BULK);
+    node.sendData(pr, {'n'}, spw::Priority::NORMAL);
+    node.sendData(pr, {'u'}, spw::Priority::URGENT);
+    node.sendData(pr, {'N'}, spw::Priority::NORMAL);
+
+    socket_writable = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::vector<uint8_t> expected_order = {'u', 'n', 'N', 'b'};
+    std::lock_guard<std::mutex> lck(send_order_access);
+    ASSERT_EQ(send_order, expected_order);
+}
+
+TEST(tcpNodePrivate, canTrackSendCompletion)
+{
+    //Declared before the node so the mock outlives it
+    //and its expectations are verified when it is deleted.
+    std::unique_ptr<MockSocket> mock_owner(new MockSocket());
+    MockSocket *mock_sock = mock_owner.get();
+    spw::TcpNodePrivate node;
+
+    std::string test_ip("192.168.1.10");
+    uint16_t test_port(4200);
+    std::string test_name("test");
+    std::vector<uint8_t> test_data = {'h', 'e', 'l', 'l', 'o'};
+
+    std::atomic<int> succeeded(0);
+    std::atomic<int> failed(0);
+
+    auto socketCreator = [&]() -> spw::ISocket* {
+         return mock_sock;
+    };
+
+    auto completion = [&](spw::Peer pr, bool success) {
+        if(success)
+        {
+            ++succeeded;
+        }
+        else
+        {
+            ++failed;
+        }
+    };
+
+    node.setSocketInterfaceCreateFunction(socketCreator);
+
+    EXPECT_CALL(*mock_sock, connect(test_ip, test_port))
+        .Times(AtLeast(1))
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*mock_sock, isConnected())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*mock_sock, peerIpAddress())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_ip));
+
+    EXPECT_CALL(*mock_sock, peerPort())
+         .Times(AtLeast(1))
+         .WillRepeatedly(Return(test_port));
+
+    EXPECT_CALL(*mock_sock, peerName())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_name));
+
+    EXPECT_CALL(*mock_sock, send(test_data))
+        .Times(1)
+        .WillOnce(Return(test_data.size()));
+
+    node.connectTo(test_ip, test_port);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    spw::Peer pr = node.latestPeer();
+
+    ASSERT_TRUE(node.sendData(pr, test_data, completion));
+    ASSERT_FALSE(node.sendData(spw::Peer(), test_data, completion));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    ASSERT_EQ(succeeded, 1);
+    ASSERT_EQ(failed, 1);
+}
+
+TEST(tcpNodePrivate, canCoalesce)
+{
+    //Declared before the node so the mock outlives it
+    //and its expectations are verified when it is deleted.
+    std::unique_ptr<MockSocket> mock_owner(new MockSocket());
+    MockSocket *mock_sock = mock_owner.get();
+    spw::TcpNodePrivate node;
+
+    std::string test_ip("192.168.1.10");
+    uint16_t test_port(4200);
+    std::string test_name("test");
+    std::vector<uint8_t> test_data = {'h', 'e', 'l', 'l', 'o'};
+    std::atomic<size_t> send_count(0);
+
+    auto socketCreator = [&]() -> spw::ISocket* {
+         return mock_sock;
+    };
+
+    node.setSocketInterfaceCreateFunction(socketCreator);
+    node.onSend([&](spw::Peer pr, size_t amount){
+        ++send_count;
+    });
 
+    EXPECT_CALL(*mock_sock, connect(test_ip, test_port))
+        .Times(AtLeast(1))
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*mock_sock, isConnected())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*mock_sock, peerIpAddress())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_ip));
+
+    EXPECT_CALL(*mock_sock, peerPort())
+         .Times(AtLeast(1))
+         .WillRepeatedly(Return(test_port));
+
+    EXPECT_CALL(*mock_sock, peerName())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_name));
+
+    EXPECT_CALL(*mock_sock, setCorked(true))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*mock_sock, setCorked(false))
+        .Times(1)
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*mock_sock, send(test_data))
+        .Times(3)
+        .WillRepeatedly(Return(test_data.size()));
+
+    node.connectTo(test_ip, test_port);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    spw::Peer pr = node.latestPeer();
+    node.setCoalescing(pr, 10000000);
+
+    node.sendData(pr, test_data);
+    node.sendData(pr, test_data);
+    node.sendData(pr, test_data);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    ASSERT_EQ(send_count, 0);
+
+    node.flush(pr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    ASSERT_EQ(send_count, 3);
+}
+
+TEST(tcpNodePrivate, canContinuePartialSend)
+{
+    //Declared before the node so the mock outlives it
+    //and its expectations are verified when it is deleted.
+    std::unique_ptr<MockSocket> mock_owner(new MockSocket());
+    MockSocket *mock_sock = mock_owner.get();
+    spw::TcpNodePrivate node;
+
+    std::string test_ip("192.168.1.10");
+    uint16_t test_port(4200);
+    std::string test_name("test");
+    std::vector<uint8_t> test_data = {'h', 'e', 'l', 'l', 'o'};
+    std::vector<uint8_t> test_rest = {'l', 'l', 'o'};
+    std::atomic<size_t> amount_sent(0);
+
+    auto socketCreator = [&]() -> spw::ISocket* {
+         return mock_sock;
+    };
+
+    node.setSocketInterfaceCreateFunction(socketCreator);
+    node.onSend([&](spw::Peer pr, size_t amount){
+        amount_sent += amount;
+    });
+
+    EXPECT_CALL(*mock_sock, connect(test_ip, test_port))
+        .Times(AtLeast(1))
+        .WillOnce(Return(true));
+
+    EXPECT_CALL(*mock_sock, isConnected())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(true));
+
+    EXPECT_CALL(*mock_sock, peerIpAddress())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_ip));
+
+    EXPECT_CALL(*mock_sock, peerPort())
+         .Times(AtLeast(1))
+         .WillRepeatedly(Return(test_port));
+
+    EXPECT_CALL(*mock_sock, peerName())
+        .Times(AtLeast(1))
+        .WillRepeatedly(Return(test_name));
+
+    EXPECT_CALL(*mock_sock, socketNumber())
+        .WillRepeatedly(Return(-1));
+
+    EXPECT_CALL(*mock_sock, getLastErrno())
+        .WillRepeatedly(Return(0));
+
+    //Only the bytes that were not written
+    //the first time are written again.
+    EXPECT_CALL(*mock_sock, send(test_data))
+        .Times(1)
+        .WillOnce(Return(2));
+
+    EXPECT_CALL(*mock_sock, send(test_rest))
+        .Times(1)
+        .WillOnce(Return(test_rest.size()));
+
+    node.connectTo(test_ip, test_port);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    spw::Peer pr = node.latestPeer();
+    ASSERT_TRUE(node.sendData(pr, test_data));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    ASSERT_EQ(amount_sent, test_data.size());
+    ASSERT_EQ(node.queuedBytes(pr), 0);
+}
+
+TEST(tcpNodePrivate, canFlushRightAfterSending)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    std::vector<uint8_t> received;
+
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+    node.connectTo("127.0.0.1", TEST_PORT);
+
+    spw::ISocket *remote = nullptr;
+    for(int i = 0; i < 100 && !remote; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        remote = server.accept();
+    }
+    ASSERT_NE(remote, nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    //sendThread has not taken the message
+    //yet when flush() is called.
+    spw::Peer pr = node.latestPeer();
+    node.setCoalescing(pr, 10000000);
+    node.sendData(pr, {1});
+    node.flush(pr);
+
+    for(int i = 0; i < 100 && received.empty(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        remote->receive(received);
+    }
+    ASSERT_EQ(received, std::vector<uint8_t>({1}));
+
+    remote->close();
+    delete remote;
+    server.close();
+}
+
+TEST(tcpNodePrivate, canFlushFromReceiveCallback)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    std::vector<uint8_t> reply;
+
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+
+    //The first sendData() of the node starts sendThread.
+    node.onReceive([&](spw::Peer pr, std::vector<uint8_t> bytes){
+        node.setCoalescing(pr, 10000000);
+        node.sendData(pr, {2});
+        node.flush(pr);
+    });
+
+    node.connectTo("127.0.0.1", TEST_PORT);
+
+    spw::ISocket *remote = nullptr;
+    for(int i = 0; i < 100 && !remote; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        remote = server.accept();
+    }
+    ASSERT_NE(remote, nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    remote->send({1});
+    for(int i = 0; i < 100 && reply.empty(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        remote->receive(reply);
+    }
+    ASSERT_EQ(reply, std::vector<uint8_t>({2}));
+
+    remote->close();
+    delete remote;
+    server.close();
+}
+
+TEST(tcpNodePrivate, canConnectInParallel)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    std::atomic<int> connected(0);
+
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+
+    node.onConnect([&](spw::Peer pr){
+        ++connected;
+    });
+
+    //An unreachable remote must not hold up the others.
+    node.connectTo("10.255.255.1", TEST_PORT);
+    for(int i = 0; i < 10; ++i)
+    {
+        node.connectTo("127.0.0.1", TEST_PORT);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    ASSERT_EQ(connected, 10);
+
+    server.close();
+}
+
+TEST(tcpNodePrivate, canResolveInBackground)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    std::atomic<int> connected(0);
+    std::atomic<int> failed(0);
+
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+    node.setResolveTimeout(300);
+
+    node.onConnect([&](spw::Peer pr){
+        ++connected;
+    });
+
+    node.onConnectError([&](spw::Message msg){
+        ++failed;
+    });
+
+    //A lookup must not hold up literal addresses.
+    node.connectTo("host.invalid", TEST_PORT);
+    node.connectTo("127.0.0.1", TEST_PORT);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(connected, 1);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    ASSERT_EQ(failed, 1);
+
+    server.close();
+}
+
+TEST(tcpNodePrivate, canConnectToAnyAddressOfHost)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    std::atomic<int> connected(0);
+
+    //localhost usually resolves to ::1 and 127.0.0.1,
+    //but only the IPv4 address accepts connections.
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+
+    node.onConnect([&](spw::Peer pr){
+        ++connected;
+    });
+
+    node.connectTo("localhost", TEST_PORT);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    ASSERT_EQ(connected, 1);
+    ASSERT_EQ(node.latestPeer().ipAddress(), "127.0.0.1");
+
+    server.close();
+}
+
+TEST(tcpNodePrivate, canReconnect)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    spw::ISocket *remote = nullptr;
+    std::atomic<uint64_t> connected_id(0);
+    std::atomic<uint64_t> reconnected_id(0);
+
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+
+    node.onConnect([&](spw::Peer pr){
+        connected_id = pr.id();
+    });
+
+    node.onReconnect([&](spw::Peer pr){
+        reconnected_id = pr.id();
+    });
+
+    spw::ReconnectPolicy policy;
+    policy.initial_delay_ms = 10;
+    node.connectTo("127.0.0.1", TEST_PORT, policy);
+
+    for(int i = 0; i < 100 && remote == nullptr; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        remote = server.accept();
+    }
+
+    ASSERT_TRUE(remote != nullptr);
+
+    //Drop the connection from the remote side.
+    remote->close();
+    delete remote;
+    remote = nullptr;
+
+    for(int i = 0; i < 250 && remote == nullptr; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        remote = server.accept();
+    }
+
+    ASSERT_TRUE(remote != nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    ASSERT_NE(connected_id, 0);
+    ASSERT_EQ(reconnected_id, connected_id);
+
+    remote->close();
+    delete remote;
+    server.close();
+}
+
+TEST(tcpNodePrivate, canPoolConnections)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    std::atomic<int> connected(0);
+    std::atomic<int> closed(0);
+
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+    node.setPoolLimits(0, 1, 200);
+
+    node.onConnect([&](spw::Peer pr){
+        ++connected;
+    });
+
+    node.onClosedConnection([&](spw::Peer pr){
+        ++closed;
+    });
+
+    ASSERT_FALSE(node.pooledPeer("127.0.0.1", TEST_PORT));
+
+    //Over loopback the first connection may already
+    //be up. Either way no second one is opened.
+    node.pooledPeer("127.0.0.1", TEST_PORT);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    spw::Peer first = node.pooledPeer("127.0.0.1", TEST_PORT);
+    spw::Peer second = node.pooledPeer("127.0.0.1", TEST_PORT);
+
+    ASSERT_TRUE(first);
+    ASSERT_EQ(first.id(), second.id());
+    ASSERT_EQ(connected, 1);
+
+    //Idle connections are closed.
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    ASSERT_EQ(closed, 1);
+
+    server.close();
+}
+
+TEST(tcpNodePrivate, canSendDataWithFastOpen)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    std::vector<uint8_t> first_data = {'h', 'e', 'l', 'l', 'o'};
+
+    server.setFastOpenQueue(16);
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+
+    //The second connection may carry the data
+    //in its SYN if the system supports it.
+    for(int round = 0; round < 2; ++round)
+    {
+        spw::ISocket *remote = nullptr;
+        std::vector<uint8_t> received;
+
+        node.connectTo("127.0.0.1", TEST_PORT, first_data);
+
+        for(int i = 0; i < 100 && remote == nullptr; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            remote = server.accept();
+        }
+
+        ASSERT_TRUE(remote != nullptr);
+
+        for(int i = 0; i < 100 && received.size() < first_data.size(); ++i)
+        {
+            std::vector<uint8_t> chunk;
+            if(remote->receive(chunk) == spw::ISocket::ReceiveResult::OK)
+            {
+                received.insert(received.end(), chunk.begin(), chunk.end());
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        }
+
+        ASSERT_EQ(received, first_data);
+        remote->close();
+        delete remote;
+    }
+
+    server.close();
+}
+
+TEST(tcpNodePrivate, canConnectToAll)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    std::vector<spw::ConnectResult> results;
+    std::atomic<int> completions(0);
+
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+
+    node.connectToAll(
+        {{"127.0.0.1", TEST_PORT},
+         {"127.0.0.1", TEST_PORT + 1},
+         {"127.0.0.1", TEST_PORT}},
+        [&](std::vector<spw::ConnectResult> res){
+            results = res;
+            ++completions;
+        });
+
+    for(int i = 0; i < 100 && completions == 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    ASSERT_EQ(completions, 1);
+    ASSERT_EQ(results.size(), 3);
+    ASSERT_TRUE(results[0].connected);
+    ASSERT_FALSE(results[1].connected);
+    ASSERT_TRUE(results[2].connected);
+    ASSERT_EQ(results[1].endpoint.port, TEST_PORT + 1);
+    ASSERT_FALSE(results[1].error.head.empty());
+    ASSERT_NE(results[0].peer.id(), results[2].peer.id());
+
+    server.close();
+}
+
+TEST(tcpNodePrivate, canShareSnapshotOfPeers)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+    ASSERT_TRUE(node.peerSnapshot()->empty());
+
+    node.connectTo("127.0.0.1", TEST_PORT);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    //Nothing is copied while the Peers stay the same.
+    auto first = node.peerSnapshot();
+    ASSERT_EQ(first->size(), 1);
+    ASSERT_EQ(node.peerSnapshot().get(), first.get());
+
+    node.connectTo("127.0.0.1", TEST_PORT);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto second = node.peerSnapshot();
+    ASSERT_NE(second.get(), first.get());
+    ASSERT_EQ(second->size(), 2);
+    ASSERT_EQ(first->size(), 1);
+
+    server.close();
+}
+
+TEST(tcpNodePrivate, canDispatchCallbacksToWorkers)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    std::vector<spw::ISocket*> remotes;
+    std::mutex access;
+    std::unordered_map<uint64_t, std::vector<uint8_t>> received;
+    std::atomic<int> connected(0);
+
+    node.setCallbackWorkers(2);
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+
+    node.onConnect([&](spw::Peer pr){
+        ++connected;
+    });
+
+    //A slow callback of one peer must not
+    //hold up the data of the other peer.
+    node.onReceive([&](spw::Peer pr, std::vector<uint8_t> bytes){
+        if(pr.id() % 2 == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        std::lock_guard<std::mutex> lck(access);
+        auto &data = received[pr.id()];
+        data.insert(data.end(), bytes.begin(), bytes.end());
+    });
+
+    node.connectTo("127.0.0.1", TEST_PORT);
+    node.connectTo("127.0.0.1", TEST_PORT);
+
+    for(int i = 0; i < 100 && remotes.size() < 2; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        spw::ISocket *remote = server.accept();
+        if(remote)
+        {
+            remotes.push_back(remote);
+        }
+    }
+
+    ASSERT_EQ(remotes.size(), 2);
+
+    for(uint8_t i = 0; i < 10; ++i)
+    {
+        for(auto remote : remotes)
+        {
+            remote->send({i});
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(15));
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    std::lock_guard<std::mutex> lck(access);
+    ASSERT_EQ(connected, 2);
+    ASSERT_EQ(received.size(), 2);
+
+    //Each peer got its bytes in order.
+    std::vector<uint8_t> expected = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    for(auto &elem : received)
+    {
+        ASSERT_EQ(elem.second, expected);
+    }
+
+    for(auto remote : remotes)
+    {
+        remote->close();
+        delete remote;
+    }
+    server.close();
+}
+
+TEST(tcpNodePrivate, canBeDestroyedWhileWorkersSend)
+{
+    spw::Socket server;
+    spw::ISocket *remote = nullptr;
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+
+    {
+        spw::TcpNodePrivate node;
+        std::atomic<int> received(0);
+
+        //Echoes that are still queued on the worker
+        //when the node is destroyed must not start
+        //threads again.
+        node.setCallbackWorkers(1);
+        node.onReceive([&](spw::Peer pr, std::vector<uint8_t> bytes){
+            ++received;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            node.sendData(pr, bytes);
+        });
+
+        node.connectTo("127.0.0.1", TEST_PORT);
+
+        for(int i = 0; i < 100 && !remote; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            remote = server.accept();
+        }
+        ASSERT_NE(remote, nullptr);
+
+        for(uint8_t i = 0; i < 5; ++i)
+        {
+            remote->send({i});
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+
+        for(int i = 0; i < 100 && received == 0; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        ASSERT_GT(received, 0);
+    }
+
+    remote->close();
+    delete remote;
+    server.close();
+}
+
+TEST(tcpNodePrivate, canDispatchConnectBeforeReceive)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    std::mutex access;
+    std::set<uint64_t> connected;
+    std::atomic<int> received(0);
+    std::atomic<int> out_of_order(0);
+
+    node.setCallbackWorkers(2);
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+
+    node.onConnect([&](spw::Peer pr){
+        std::lock_guard<std::mutex> lck(access);
+        connected.insert(pr.id());
+    });
+
+    node.onReceive([&](spw::Peer pr, std::vector<uint8_t> bytes){
+        std::lock_guard<std::mutex> lck(access);
+        if(connected.count(pr.id()) == 0)
+        {
+            ++out_of_order;
+        }
+        ++received;
+    });
+
+    //The remotes send right after accepting, so
+    //the data is often there before onConnect().
+    std::vector<spw::ISocket*> remotes;
+    for(int i = 0; i < 10; ++i)
+    {
+        node.connectTo("127.0.0.1", TEST_PORT);
+
+        spw::ISocket *remote = nullptr;
+        for(int j = 0; j < 100 && !remote; ++j)
+        {
+            remote = server.accept();
+            if(!remote)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+        ASSERT_NE(remote, nullptr);
+        remote->send({1});
+        remotes.push_back(remote);
+    }
+
+    for(int i = 0; i < 100 && received < 10; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    ASSERT_EQ(received, 10);
+    ASSERT_EQ(out_of_order, 0);
+
+    for(auto remote : remotes)
+    {
+        remote->close();
+        delete remote;
+    }
+    server.close();
+}
+
+TEST(tcpNodePrivate, canRunWithoutThreads)
+{
+    spw::TcpNodePrivate node(spw::IpVersion::IPV4, spw::RunMode::POLL);
+    spw::Socket client;
+    spw::Peer accepted;
+    std::vector<uint8_t> received;
+    std::thread::id caller = std::this_thread::get_id();
+    bool on_caller = true;
+
+    node.onAccept([&](spw::Peer pr){
+        accepted = pr;
+        on_caller = on_caller && std::this_thread::get_id() == caller;
+    });
+    node.onReceive([&](spw::Peer pr, std::vector<uint8_t> bytes){
+        received.insert(received.end(), bytes.begin(), bytes.end());
+        on_caller = on_caller && std::this_thread::get_id() == caller;
+    });
+
+    //Nothing happens until poll() is called.
+    node.doListen(TEST_PORT, spw::IpVersion::IPV4);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    spw::Socket probe;
+    ASSERT_FALSE(probe.connect("127.0.0.1", TEST_PORT));
+
+    node.poll(0);
+    ASSERT_TRUE(client.connect("127.0.0.1", TEST_PORT));
+
+    for(int i = 0; i < 50 && !accepted.isValid(); ++i)
+    {
+        node.poll(10);
+    }
+    ASSERT_TRUE(accepted.isValid());
+
+    client.send({1, 2, 3});
+    for(int i = 0; i < 50 && received.size() < 3; ++i)
+    {
+        node.poll(10);
+    }
+    ASSERT_EQ(received, std::vector<uint8_t>({1, 2, 3}));
+
+    ASSERT_TRUE(node.sendData(accepted, {4, 5}));
+    node.poll(10);
+
+    std::vector<uint8_t> answer;
+    for(int i = 0; i < 50 && answer.empty(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        client.receive(answer);
+    }
+    ASSERT_EQ(answer, std::vector<uint8_t>({4, 5}));
+
+    //Connecting is done by poll() as well.
+    spw::Peer connected;
+    node.onConnect([&](spw::Peer pr){
+        connected = pr;
+        on_caller = on_caller && std::this_thread::get_id() == caller;
+    });
+    node.connectTo("127.0.0.1", TEST_PORT);
+    for(int i = 0; i < 50 && !connected.isValid(); ++i)
+    {
+        node.poll(10);
+    }
+    ASSERT_TRUE(connected.isValid());
+    ASSERT_TRUE(on_caller);
+
+    client.close();
+}
+
+#ifdef __linux__
+//pollDescriptor() is only available on Linux
+TEST(tcpNodePrivate, canRunInsideForeignEventLoop)
+{
+    spw::TcpNodePrivate node(spw::IpVersion::IPV4, spw::RunMode::POLL);
+    spw::Poller loop;
+    spw::Socket client;
+    std::vector<uint8_t> received;
+    std::vector<spw::Poller::Event> events;
+
+    ASSERT_EQ(spw::TcpNodePrivate().pollDescriptor(), -1);
+    ASSERT_TRUE(loop.add(node.pollDescriptor(), spw::Poller::READABLE));
+
+    node.onReceive([&](spw::Peer pr, std::vector<uint8_t> bytes){
+        received.insert(received.end(), bytes.begin(), bytes.end());
+    });
+
+    //doListen() makes the descriptor readable.
+    node.doListen(TEST_PORT, spw::IpVersion::IPV4);
+    ASSERT_EQ(loop.wait(events, 100), 1);
+    node.processEvents();
+    ASSERT_TRUE(client.connect("127.0.0.1", TEST_PORT));
+
+    client.send({1, 2, 3});
+    for(int i = 0; i < 50 && received.size() < 3; ++i)
+    {
+        int timeout_ms = node.pollTimeout();
+        loop.wait(events, timeout_ms == -1 ? 100 : timeout_ms);
+        node.processEvents();
+    }
+    ASSERT_EQ(received, std::vector<uint8_t>({1, 2, 3}));
+
+    //Nothing left to do, so the descriptor stays quiet.
+    ASSERT_EQ(node.pollTimeout(), -1);
+    ASSERT_EQ(loop.wait(events, 20), 0);
+
+    client.close();
+}
+#endif
+
+#ifdef __linux__
+//Thread names and affinity are read from /proc
+TEST(tcpNodePrivate, canPinAndNameThreads)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    spw::ThreadOptions options;
+    options.cpus = {0};
+
+    ASSERT_TRUE(node.setThreadOptions(spw::NodeThread::SEND, options));
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+    node.connectTo("127.0.0.1", TEST_PORT);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    spw::PeerList peers = node.allPeers();
+    ASSERT_EQ(peers.size(), 1);
+    node.sendData(peers.begin()->second, {1});
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::unordered_map<std::string, pid_t> threads;
+    DIR *tasks = opendir("/proc/self/task");
+    ASSERT_NE(tasks, nullptr);
+    while(dirent *task = readdir(tasks))
+    {
+        std::string path = std::string("/proc/self/task/") + 
+                           task->d_name + "/comm";
+        FILE *comm = fopen(path.c_str(), "r");
+        char name[32] = {0};
+        if(comm && fgets(name, sizeof(name), comm))
+        {
+            name[strcspn(name, "\n")] = 0;
+            threads[name] = atoi(task->d_name);
+        }
+        if(comm)
+        {
+            fclose(comm);
+        }
+    }
+    closedir(tasks);
+
+    ASSERT_EQ(threads.count("spw-listen"), 1);
+    ASSERT_EQ(threads.count("spw-connect"), 1);
+    ASSERT_EQ(threads.count("spw-send"), 1);
+
+    cpu_set_t cpus;
+    ASSERT_EQ(sched_getaffinity(threads["spw-send"], sizeof(cpus), &cpus), 0);
+    ASSERT_EQ(CPU_COUNT(&cpus), 1);
+    ASSERT_TRUE(CPU_ISSET(0, &cpus));
+
+    //Running threads are changed right away.
+    ASSERT_TRUE(node.setThreadOptions(spw::NodeThread::LISTEN, options));
+    ASSERT_EQ(sched_getaffinity(threads["spw-listen"], sizeof(cpus), &cpus), 0);
+    ASSERT_EQ(CPU_COUNT(&cpus), 1);
+    ASSERT_TRUE(CPU_ISSET(0, &cpus));
+
+    server.close();
+}
+#endif
+
+TEST(tcpNodePrivate, canBusyPoll)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    std::atomic<bool> received(false);
+
+    //Without spinning, receiving would wait
+    //for the long sleep time.
+    node.setSleepTime(1000);
+    node.setBusyPoll(2000000);
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+
+    node.onReceive([&](spw::Peer pr, std::vector<uint8_t> bytes){
+        received = true;
+    });
+
+    node.connectTo("127.0.0.1", TEST_PORT);
+
+    spw::ISocket *remote = nullptr;
+    for(int i = 0; i < 100 && !remote; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        remote = server.accept();
+    }
+    ASSERT_NE(remote, nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    remote->send({1});
+    for(int i = 0; i < 50 && !received; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    ASSERT_TRUE(received);
+
+    node.setBusyPoll(0);
+    remote->close();
+    delete remote;
+    server.close();
+}
+
+TEST(tcpNodePrivate, canWakeUpWhenDataArrives)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    std::atomic<bool> received(false);
+
+    //The spin budget is long over when the data
+    //arrives, so listenThread must be parked on
+    //the sockets instead of sleeping.
+    node.setSleepTime(1000);
+    node.setBusyPoll(1000);
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+
+    node.onReceive([&](spw::Peer pr, std::vector<uint8_t> bytes){
+        received = true;
+    });
+
+    node.connectTo("127.0.0.1", TEST_PORT);
+
+    spw::ISocket *remote = nullptr;
+    for(int i = 0; i < 100 && !remote; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        remote = server.accept();
+    }
+    ASSERT_NE(remote, nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    remote->send({1});
+    for(int i = 0; i < 50 && !received; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    ASSERT_TRUE(received);
+
+    node.setBusyPoll(0);
+    remote->close();
+    delete remote;
+    server.close();
+}
+
+TEST(tcpNodePrivate, canReplaceCallbacksWhileReceiving)
+{
+    spw::TcpNodePrivate node;
+    spw::Socket server;
+    std::atomic<int> received(0);
+
+    server.listen(TEST_PORT, spw::IpVersion::IPV4);
+    node.connectTo("127.0.0.1", TEST_PORT);
+
+    spw::ISocket *remote = nullptr;
+    for(int i = 0; i < 100 && !remote; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        remote = server.accept();
+    }
+    ASSERT_NE(remote, nullptr);
+
+    //Replaced tables are freed while the listen
+    //thread keeps reading the current one.
+    for(int i = 0; i < 2000; ++i)
+    {
+        node.onReceive([&received](spw::Peer pr, std::vector<uint8_t> bytes){
+            ++received;
+        });
+        if(i % 100 == 0)
+        {
+            remote->send({1});
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    for(int i = 0; i < 100 && received == 0; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    ASSERT_GT(received, 0);
+
+    remote->close();
+    delete remote;
+    server.close();
+}
+
+TEST(tcpNodePrivate, canHandleEmptyPeers)
+{
+    spw::TcpNodePrivate node;
+    spw::Peer empty;
+    spw::Peer copy = empty;
+
+    ASSERT_FALSE(copy);
+    ASSERT_EQ(copy.id(), 0);
+    ASSERT_EQ(copy.ipAddress(), "");
+    ASSERT_FALSE(node.sendData(copy, {1, 2, 3}));
+    ASSERT_EQ(node.queuedBytes(copy), 0);
+    node.disconnectPeer(copy);
+}